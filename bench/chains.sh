@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# Compiles generated 5-, 10- and 20-stage chains, both as nested eager stages and as
+# flat lazy() chains, and reports the compile time and section sizes of each object.
+# Times are the best of REPEAT compiles (5 by default); `+ms` subtracts the 0-stage
+# chain of the same kind, leaving the cost of the stages without the header parse.
+#
+# Usage: chains.sh <compiler> <include dir> <work dir> [compiler flags...]
+set -euo pipefail
+
+compiler=$1
+include=$2
+work=$3
+shift 3
+size=${SIZE:-size}
+repeat=${REPEAT:-5}
+mkdir -p "$work"
+
+# Alternates maps and filters so every stage adds a distinct lambda type.
+generate() {
+    local stages=$1 source=$2
+    {
+        echo '#include "stream.hpp"'
+        echo '#include <vector>'
+        echo "usize run(std::vector<int>& values) {"
+        printf '    return Stream(values)%s' "$source"
+        for ((i = 0; i < stages; ++i)); do
+            if ((i % 2 == 0)); then
+                printf '\n        .map<int>([](int x) { return x * 3 + %d; })' "$i"
+            else
+                printf '\n        .filter([](int x) { return (x & 1023) != %d; })' "$i"
+            fi
+        done
+        printf '\n        .count();\n}\n'
+    }
+}
+
+# The best of `repeat` compiles of $1 into $2, in milliseconds.
+compile() {
+    local best=
+    for ((run = 0; run < repeat; ++run)); do
+        local start=$(date +%s%N)
+        "$compiler" "${flags[@]}" -I "$include" -c "$1" -o "$2"
+        local elapsed=$((($(date +%s%N) - start) / 1000000))
+        if [[ -z $best ]] || ((elapsed < best)); then best=$elapsed; fi
+    done
+    echo "$best"
+}
+
+flags=("$@")
+declare -A baseline
+printf '%-8s %-7s %10s %10s %10s %10s %10s\n' kind stages ms +ms text data object
+for stages in 0 5 10 20; do
+    for kind in eager lazy; do
+        name="$work/${kind}_$stages"
+        if [[ $kind == lazy ]]; then generate "$stages" '.lazy()'; else generate "$stages" ''; fi > "$name.cpp"
+        elapsed=$(compile "$name.cpp" "$name.o")
+        ((stages == 0)) && baseline[$kind]=$elapsed
+        read -r text data _ < <("$size" "$name.o" | tail -n 1)
+        printf '%-8s %-7s %10s %10s %10s %10s %10s\n' "$kind" "$stages" "$elapsed" \
+            "$((elapsed - baseline[$kind]))" "$text" "$data" "$(stat -c %s "$name.o")"
+    done
+done
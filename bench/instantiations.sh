@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# Lists the code each template instantiation contributes to the given objects, largest
+# first, followed by the totals per template.
+#
+# Usage: instantiations.sh [-n count] <object>...
+set -euo pipefail
+
+count=20
+if [[ ${1:-} == -n ]]; then
+    count=$2
+    shift 2
+fi
+nm=${NM:-nm}
+
+for object in "$@"; do
+    echo "== $object"
+    "$nm" -C -S -t d --size-sort --defined-only "$object" | awk -v count="$count" '
+        $3 ~ /^[tTwW]$/ {
+            size = $2 + 0
+            name = $0
+            sub(/^[^ ]+ [^ ]+ [^ ]+ /, "", name)
+            symbols[name] += size
+            # The template is the first name before its arguments, past any return type.
+            key = name
+            sub(/[<(].*$/, "", key)
+            sub(/^.* /, "", key)
+            templates[key] += size
+            instances[key] += 1
+            total += size
+        }
+        END {
+            printf "%10s  %s\n", "bytes", "instantiation"
+            sorted = "sort -rn | head -n " count
+            for (name in symbols) { printf "%10d  %s\n", symbols[name], name | sorted }
+            close(sorted)
+            printf "\n%10s  %6s  %s\n", "bytes", "count", "template"
+            sorted = "sort -rn"
+            for (key in templates) { printf "%10d  %6d  %s\n", templates[key], instances[key], key | sorted }
+            close(sorted)
+            printf "%10d  total\n", total
+        }'
+done
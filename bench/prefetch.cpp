@@ -0,0 +1,73 @@
+// Compares plain iteration with prefetch(distance) over pointer-chasing sources: a
+// std::set, whose nodes are scattered by random insertion, and a shuffled vector of
+// pointers into a larger pool.
+
+#include "stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace
+{
+    constexpr usize Elements = 2'000'000;
+    constexpr int Rounds = 5;
+
+    // The best of `Rounds` runs, in milliseconds.
+    template <typename FRun>
+    double measure(FRun run) {
+        double best = 1e300;
+        for (int round = 0; round < Rounds; ++round) {
+            auto start = std::chrono::steady_clock::now();
+            volatile int64_t result = run();
+            (void) result;
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    int64_t load(int64_t value) { return value; }
+
+    int64_t load(const int64_t* value) { return *value; }
+
+    template <typename TCollection>
+    void report(const char* source, TCollection& collection) {
+        double plain = measure([&] {
+            int64_t sum = 0;
+            Stream(collection).forEach([&](const auto& value) { sum += load(value); });
+            return sum;
+        });
+        std::printf("%-16s %-11s %8.2f ms\n", source, "plain", plain);
+        for (usize distance : {1, 4, 16, 64}) {
+            double prefetched = measure([&] {
+                int64_t sum = 0;
+                Stream(collection).prefetch(distance).forEach([&](const auto& value) { sum += load(value); });
+                return sum;
+            });
+            std::printf("%-16s prefetch %-2zu %8.2f ms  %+6.1f%%\n",
+                source, distance, prefetched, (prefetched / plain - 1) * 100);
+        }
+    }
+}
+
+int main() {
+    std::mt19937_64 random(42);
+
+    std::vector<int64_t> keys(Elements);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), random);
+    std::set<int64_t> set(keys.begin(), keys.end());
+    report("std::set", set);
+
+    std::vector<int64_t> pool(Elements * 8);
+    std::iota(pool.begin(), pool.end(), 0);
+    std::vector<const int64_t*> pointers(Elements);
+    for (usize i = 0; i < Elements; ++i) { pointers[i] = &pool[i * 8]; }
+    std::shuffle(pointers.begin(), pointers.end(), random);
+    report("pointer vector", pointers);
+}
@@ -0,0 +1,73 @@
+// Times sum(SumMode) for every mode, on a sequential and a parallel stream, and reports
+// the relative error of each against the exact sum. The values mix magnitudes from
+// 2^-30 to 2^30 with random signs, and are all multiples of 2^-30, so the exact sum is
+// an integer count of 2^-30 that fits in 128 bits.
+
+#include "stream.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr usize Elements = 10'000'000;
+    constexpr int Rounds = 5;
+    constexpr int Scale = 30;
+
+    // The best of `Rounds` runs in milliseconds, and the result of the last.
+    template <typename FRun>
+    std::pair<double, double> measure(FRun run) {
+        double best = 1e300;
+        double result = 0;
+        for (int round = 0; round < Rounds; ++round) {
+            auto start = std::chrono::steady_clock::now();
+            result = double(run());
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return { best, result };
+    }
+
+    const char* name(SumMode mode) {
+        switch (mode) {
+            case SumMode::Fast: return "Fast";
+            case SumMode::Compensated: return "Compensated";
+            case SumMode::Pairwise: return "Pairwise";
+            case SumMode::Deterministic: return "Deterministic";
+        }
+        return "?";
+    }
+}
+
+int main() {
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<int64_t> mantissa(-(1 << 20), 1 << 20);
+    std::uniform_int_distribution<int> exponent(-Scale, Scale);
+    std::vector<double> values(Elements);
+    __int128 exact = 0;
+    for (double& value : values) {
+        int64_t m = mantissa(random);
+        int e = exponent(random);
+        value = std::ldexp(double(m), e);
+        exact += __int128(m) << (e + Scale);
+    }
+    long double reference = std::ldexp(static_cast<long double>(exact), -Scale);
+
+    auto error = [&](double sum) { return double(std::fabs((sum - reference) / reference)); };
+
+    auto [plain, plainSum] = measure([&] { return std::accumulate(values.begin(), values.end(), 0.0); });
+    std::printf("%zu doubles, %u hardware threads\n\n", Elements, std::thread::hardware_concurrency());
+    std::printf("%-16s %12s %12s %12s %12s\n", "mode", "seq ms", "seq error", "par ms", "par error");
+    std::printf("%-16s %12.2f %12.2e %12s %12s\n", "std::accumulate", plain, error(plainSum), "-", "-");
+    for (SumMode mode : { SumMode::Fast, SumMode::Compensated, SumMode::Pairwise, SumMode::Deterministic }) {
+        auto [sequential, sequentialSum] = measure([&] { return Stream(values).sum(mode); });
+        auto [parallel, parallelSum] = measure([&] { return Stream(values).parallel().sum(mode); });
+        std::printf("%-16s %12.2f %12.2e %12.2f %12.2e\n",
+            name(mode), sequential, error(sequentialSum), parallel, error(parallelSum));
+    }
+}
@@ -1,14 +1,389 @@
 #ifndef STREAM_HPP
 #define STREAM_HPP
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cerrno>
+#include <cmath>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <istream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <map>
 #include <unordered_map>
 #include <set>
 #include <unordered_set>
 
+#if __has_include(<flat_set>)
+#include <flat_set>
+#endif
+#if __has_include(<flat_map>)
+#include <flat_map>
+#endif
+
+// Define STREAM_HPP_EXECUTION to get PolicyExecutor. <execution> is opt-in because with
+// libstdc++ it makes every including program link against TBB.
+#if defined(STREAM_HPP_EXECUTION)
+#include <execution>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#endif
+
 using usize = std::size_t;
 
+#if defined(__GNUC__)
+#define STREAM_COLD [[gnu::cold, gnu::noinline]]
+#elif defined(_MSC_VER)
+#define STREAM_COLD __declspec(noinline)
+#else
+#define STREAM_COLD
+#endif
+
+namespace detail
+{
+    // Kernels shared by every stream instantiation, kept out of the per-lambda templates.
+
+    template <typename TException = std::invalid_argument>
+    [[noreturn]] STREAM_COLD void fail(const char* message) {
+        throw TException(message);
+    }
+
+    inline void copyBytes(void* destination, const void* source, usize bytes) {
+        if (bytes != 0) { std::memcpy(destination, source, bytes); }
+    }
+
+    constexpr usize MaskBatch = 256;
+
+    // Counts the set bytes of a 0/1 mask; written so that it vectorizes.
+    inline usize countMask(const uint8_t* mask, usize count) {
+        usize result = 0;
+        for (usize i = 0; i < count; ++i) { result += mask[i]; }
+        return result;
+    }
+
+    constexpr usize PageSize = 4096;
+
+    /**
+     * The machine's NUMA nodes and the CPUs on each, read from sysfs on Linux. Everywhere
+     * else, and whenever sysfs is unavailable, the machine is treated as a single node.
+     */
+    class NumaTopology
+    {
+      private:
+
+        std::vector<std::vector<int>> cpus;
+
+        static std::vector<int> parseCpuList(const std::string& list) {
+            std::vector<int> result;
+            usize position = 0;
+            while (position < list.size()) {
+                usize comma = std::min(list.find(',', position), list.size());
+                std::string range = list.substr(position, comma - position);
+                usize dash = range.find('-');
+                int first = std::stoi(range);
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) { result.push_back(cpu); }
+                position = comma + 1;
+            }
+            return result;
+        }
+
+        NumaTopology() {
+#if defined(__linux__)
+            for (usize node = 0;; ++node) {
+                std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string list;
+                if (!file || !std::getline(file, list)) { break; }
+                try {
+                    cpus.push_back(parseCpuList(list));
+                } catch (const std::exception&) {
+                    cpus.clear();
+                    break;
+                }
+            }
+#endif
+            if (cpus.empty()) { cpus.emplace_back(); }
+        }
+
+      public:
+
+        static const NumaTopology& get() {
+            static const NumaTopology topology;
+            return topology;
+        }
+
+        usize nodes() const { return cpus.size(); }
+
+        // Workers are spread over nodes in contiguous blocks.
+        usize nodeOf(usize worker, usize workers) const { return worker * cpus.size() / workers; }
+
+        // Restricts the calling thread to the CPUs of `node`. A no-op on single-node machines.
+        void pin(usize node) const {
+#if defined(__linux__)
+            if (cpus.size() < 2 || cpus[node].empty()) { return; }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus[node]) { CPU_SET(cpu, &set); }
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+            (void) node;
+#endif
+        }
+
+        // Pins the calling thread to `node` for its lifetime, then restores its affinity.
+        class Pin
+        {
+          private:
+
+#if defined(__linux__)
+            cpu_set_t saved;
+            bool restore = false;
+#endif
+
+          public:
+
+            Pin(const NumaTopology& topology, usize node) {
+#if defined(__linux__)
+                if (topology.nodes() < 2) { return; }
+                restore = pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0;
+#endif
+                topology.pin(node);
+            }
+
+            Pin(const Pin&) = delete;
+            Pin& operator=(const Pin&) = delete;
+
+            ~Pin() {
+#if defined(__linux__)
+                if (restore) { pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved); }
+#endif
+            }
+        };
+    };
+
+    // Moves `index` forward to the first element that starts on a page boundary of `base`.
+    template <typename T>
+    usize alignToPage(const T* base, usize index, usize length) {
+        auto address = reinterpret_cast<std::uintptr_t>(base + index);
+        usize padding = (PageSize - address % PageSize) % PageSize;
+        return std::min(length, index + (padding + sizeof(T) - 1) / sizeof(T));
+    }
+
+    // Prefetches an element, or what it points to when it is a pointer.
+    template <typename T>
+    void prefetch(const T& value) {
+#if defined(__GNUC__)
+        if constexpr (std::is_pointer_v<T>) {
+            __builtin_prefetch(value);
+        } else {
+            __builtin_prefetch(&value);
+        }
+#else
+        (void) value;
+#endif
+    }
+
+    // Visits `[iter, end)` in order until `visitor` returns false, keeping a second
+    // iterator `distance` elements ahead that prefetches as it goes.
+    template <typename TIterator, typename FVisitor>
+    bool traverse(TIterator iter, const TIterator& end, usize distance, FVisitor&& visitor) {
+        // A single-pass source may release what the lead has passed.
+        if (distance == 0 || !std::forward_iterator<TIterator>) {
+            for (; iter != end; ++iter) {
+                if (!visitor(*iter)) { return false; }
+            }
+            return true;
+        }
+        TIterator lead = iter;
+        for (usize i = 0; i < distance && lead != end; ++i, ++lead) { prefetch(*lead); }
+        for (; iter != end; ++iter) {
+            if (lead != end) {
+                prefetch(*lead);
+                ++lead;
+            }
+            if (!visitor(*iter)) { return false; }
+        }
+        return true;
+    }
+
+    template <typename T>
+    concept Text = std::convertible_to<const T&, std::string_view>;
+
+    template <typename T>
+    concept Number = std::is_arithmetic_v<T> && !std::same_as<T, bool>;
+
+    // Narrow code units, which still add up like numbers but are written out as text.
+    template <typename T>
+    concept Character = std::same_as<T, char> || std::same_as<T, char8_t>;
+
+    // An upper bound on the characters `std::to_chars` writes for any value of `T`.
+    template <Number T>
+    constexpr usize maxChars() {
+        if constexpr (std::is_integral_v<T>) {
+            return std::numeric_limits<T>::digits10 + 3;
+        } else {
+            return std::numeric_limits<T>::max_digits10 + 10;
+        }
+    }
+
+    // Appends `value` to `out` in place, growing it by at most `maxChars<T>()`.
+    template <Number T>
+    void appendNumber(std::string& out, T value) {
+        usize size = out.size();
+        out.resize(size + maxChars<T>());
+        std::to_chars_result written = std::to_chars(out.data() + size, out.data() + out.size(), value);
+        out.resize(written.ptr - out.data());
+    }
+
+    template <typename T>
+        requires Text<T> || Number<T>
+    void appendText(std::string& out, const T& value) {
+        if constexpr (Text<T>) {
+            out.append(std::string_view(value));
+        } else if constexpr (Character<T>) {
+            out.push_back(char(value));
+        } else {
+            appendNumber(out, value);
+        }
+    }
+
+    // Either appends a line itself given `(std::string&, value)`, or returns text or a number.
+    template <typename F, typename T>
+    concept LineFormatter = std::invocable<F&, std::string&, const T&> || requires(F& formatter, const T& value) {
+        requires Text<std::remove_cvref_t<decltype(formatter(value))>>
+            || Number<std::remove_cvref_t<decltype(formatter(value))>>;
+    };
+
+    /**
+     * Gathers formatted lines in one reusable buffer and hands it to `sink(data, size)`
+     * in large writes, instead of one write, and often one flush, per line.
+     */
+    template <typename FSink>
+    class LineWriter
+    {
+      private:
+
+        static constexpr usize FlushSize = 64 * 1024;
+
+        FSink sink;
+        std::string buffer;
+
+      public:
+
+        explicit LineWriter(FSink sink) : sink(std::move(sink)) {
+            buffer.reserve(FlushSize + 256);
+        }
+
+        template <typename T, LineFormatter<T> FFormatter>
+        void write(FFormatter& formatter, const T& value) {
+            if constexpr (std::invocable<FFormatter&, std::string&, const T&>) {
+                formatter(buffer, value);
+            } else {
+                appendText(buffer, formatter(value));
+            }
+            buffer.push_back('\n');
+            if (buffer.size() >= FlushSize) { flush(); }
+        }
+
+        void flush() {
+            if (buffer.empty()) { return; }
+            sink(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    };
+
+#if __has_include(<unistd.h>)
+    // Writes everything to a file descriptor, resuming after partial writes and signals.
+    struct DescriptorSink
+    {
+        int fd;
+
+        void operator()(const char* data, usize size) const {
+            while (size != 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0 && errno == EINTR) { continue; }
+                if (written < 0) { throw std::system_error(errno, std::generic_category(), "Stream::writeLines"); }
+                data += written;
+                size -= usize(written);
+            }
+        }
+    };
+#endif
+
+    /**
+     * Hands `[begin, end)` to `consume(batch, count)` as arrays of up to `MaskBatch`
+     * element pointers. Elements of iterators that yield temporaries are copied into a
+     * buffer first so that the pointers stay valid for the whole batch.
+     */
+    template <typename T, typename TIterator, typename FConsume>
+    void forEachBatch(const TIterator& begin, const TIterator& end, usize prefetch, FConsume consume) {
+        constexpr bool copies = !std::is_lvalue_reference_v<std::iter_reference_t<TIterator>>;
+        std::array<const T*, MaskBatch> batch;
+        std::conditional_t<copies, std::array<T, MaskBatch>, std::array<T, 0>> buffer;
+        usize count = 0;
+        traverse(begin, end, prefetch, [&](const T& value) {
+            if constexpr (copies) {
+                buffer[count] = value;
+                batch[count] = &buffer[count];
+            } else {
+                batch[count] = &value;
+            }
+            if (++count == MaskBatch) {
+                consume(batch.data(), count);
+                count = 0;
+            }
+            return true;
+        });
+        if (count != 0) { consume(batch.data(), count); }
+    }
+
+    template <typename TIterator>
+    TIterator advance(TIterator iter, usize count, const TIterator& end) {
+        return std::ranges::next(iter, static_cast<std::iter_difference_t<TIterator>>(count), end);
+    }
+
+    // Keeps a single-pass source from releasing what `iter` reaches while the result lives.
+    template <typename TIterator>
+    auto hold(const TIterator& iter) {
+        if constexpr (requires { iter.hold(); }) {
+            return iter.hold();
+        } else {
+            return 0;
+        }
+    }
+}
+
 template <typename D, typename B>
 concept Derives = std::is_base_of_v<B, D>;
 
@@ -20,8 +395,8 @@ concept Destructible = std::is_trivially_destructible_v<T>;
 
 template <typename TCollection>
 concept Iterable = requires(TCollection iterable) {
-    { iterable.begin() } -> std::template same_as<decltype(std::begin(iterable))>;
-    { iterable.end() } -> std::template same_as<decltype(std::end(iterable))>;
+    { iterable.begin() } -> std::same_as<decltype(std::begin(iterable))>;
+    { iterable.end() } -> std::same_as<decltype(std::end(iterable))>;
 };
 
 template <typename T>
@@ -112,268 +487,4350 @@ struct Collection<std::set<T>>
     using Value = typename std::set<T>::value_type;
     template <typename R>
     using WithValueType = std::set<R>;
+    static constexpr bool Sorted = true;
 
     static void insert(std::set<Value>& collection, auto value) {
         collection.insert(value);
     }
 };
 
-template <Iterable TCollection>
-class Stream;
-
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    typename R, Mapper<typename TStream::Value, R> FMapper>
-class Map;
-
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    Predicate<typename TStream::Value> FPredicate>
-class Filter;
+/**
+ * A set stored as a sorted, duplicate-free vector. Building one from a batch of values
+ * sorts and deduplicates once; lookups are binary searches over contiguous memory.
+ */
+template <typename T, typename TCompare = std::less<T>>
+class FlatSet
+{
+  private:
 
-template <Iterable TCollection>
-struct Take;
+    std::vector<T> values;
+    TCompare compare;
 
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    Predicate<typename TStream::Value> FPredicate>
-struct TakeWhile;
+    bool equivalent(const T& a, const T& b) const { return !compare(a, b) && !compare(b, a); }
 
-template <Iterable TCollection>
-struct Skip;
+  public:
 
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    Predicate<typename TStream::Value> FPredicate>
-struct SkipWhile;
+    using value_type = T;
+    using size_type = usize;
+    using const_iterator = typename std::vector<T>::const_iterator;
+    using iterator = const_iterator;
 
-template <Iterable TCollection>
-class Stream
-{
-  protected:
+    FlatSet() = default;
 
-    using Iterator = typename TCollection::const_iterator;
+    explicit FlatSet(std::vector<T> values, TCompare compare = {}) : values(std::move(values)), compare(compare) {
+        // Set operations and ordered sources hand over values that are already sorted.
+        if (!std::is_sorted(this->values.begin(), this->values.end(), this->compare)) {
+            std::sort(this->values.begin(), this->values.end(), this->compare);
+        }
+        auto last = std::unique(this->values.begin(), this->values.end(), [&](const T& a, const T& b) {
+            return equivalent(a, b);
+        });
+        this->values.erase(last, this->values.end());
+    }
 
-    Iterator begin;
-    Iterator end;
+    const_iterator begin() const { return values.begin(); }
 
-    Stream() = default;
+    const_iterator end() const { return values.end(); }
 
-  public:
+    usize size() const { return values.size(); }
 
-    using Value = typename TCollection::value_type;
+    bool empty() const { return values.empty(); }
 
-    explicit Stream(TCollection& collection) : begin(collection.begin()), end(collection.end()) {}
+    const_iterator lower_bound(const T& value) const {
+        return std::lower_bound(values.begin(), values.end(), value, compare);
+    }
 
-    template <typename R, Mapper<Value, R> FMapper>
-    auto map(FMapper mapper) -> Map<TCollection, Stream, R, FMapper> {
-        return Map<TCollection, Stream, R, FMapper>(mapper, begin, end);
+    const_iterator upper_bound(const T& value) const {
+        return std::upper_bound(values.begin(), values.end(), value, compare);
     }
 
-    template <Predicate<Value> FPredicate>
-    auto filter(FPredicate predicate) -> Filter<TCollection, Stream, FPredicate> {
-        return Filter<TCollection, Stream, FPredicate>(predicate, begin, end);
+    const_iterator find(const T& value) const {
+        auto iter = lower_bound(value);
+        return iter != values.end() && !compare(value, *iter) ? iter : values.end();
     }
 
-    auto take(usize count) -> Take<TCollection> {
-        return Take<TCollection>(count, begin, end);
+    bool contains(const T& value) const { return find(value) != values.end(); }
+
+    usize count(const T& value) const { return contains(value) ? 1 : 0; }
+
+    // Amortized O(1) when values arrive in order, as they do from a filtered FlatSet.
+    bool insert(const T& value) {
+        auto iter = values.empty() || compare(values.back(), value) ? values.end() : lower_bound(value);
+        if (iter != values.end() && !compare(value, *iter)) { return false; }
+        values.insert(iter, value);
+        return true;
     }
+};
 
-    template <Predicate<Value> FPredicate>
-    auto takeWhile(FPredicate predicate) -> TakeWhile<TCollection, Stream, FPredicate> {
-        return TakeWhile<TCollection, Stream, FPredicate>(predicate, begin, end);
+/**
+ * A map stored as a vector of key-value pairs sorted by key. Like `std::map`, the first
+ * value seen for a key wins.
+ */
+template <typename K, typename V, typename TCompare = std::less<K>>
+class FlatMap
+{
+  private:
+
+    std::vector<std::pair<K, V>> entries;
+    TCompare compare;
+
+    auto byKey() const {
+        return [this](const std::pair<K, V>& a, const std::pair<K, V>& b) { return compare(a.first, b.first); };
     }
 
-    auto skip(usize count) -> Skip<TCollection> {
-        return Skip<TCollection>(count, begin, end);
+  public:
+
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using size_type = usize;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+    using iterator = const_iterator;
+
+    FlatMap() = default;
+
+    explicit FlatMap(std::vector<value_type> entries, TCompare compare = {})
+        : entries(std::move(entries)), compare(compare) {
+        std::stable_sort(this->entries.begin(), this->entries.end(), byKey());
+        auto last = std::unique(this->entries.begin(), this->entries.end(), [&](const value_type& a, const value_type& b) {
+            return !this->compare(a.first, b.first) && !this->compare(b.first, a.first);
+        });
+        this->entries.erase(last, this->entries.end());
     }
 
-    template <Predicate<Value> FPredicate>
-    auto skipWhile(FPredicate predicate) -> SkipWhile<TCollection, Stream, FPredicate> {
-        return SkipWhile<TCollection, Stream, FPredicate>(predicate, begin, end);
+    const_iterator begin() const { return entries.begin(); }
+
+    const_iterator end() const { return entries.end(); }
+
+    usize size() const { return entries.size(); }
+
+    bool empty() const { return entries.empty(); }
+
+    const_iterator lower_bound(const K& key) const {
+        return std::lower_bound(entries.begin(), entries.end(), key, [this](const value_type& entry, const K& key) {
+            return compare(entry.first, key);
+        });
     }
 
-    template <Consumer<const Value&> FConsumer>
-    void forEach(FConsumer consumer) {
-        for (auto iter = begin; iter != end; ++iter) {
-            consumer(*iter);
-        }
+    const_iterator find(const K& key) const {
+        auto iter = lower_bound(key);
+        return iter != entries.end() && !compare(key, iter->first) ? iter : entries.end();
     }
 
-    template <KeyValueConsumer<usize, const Value&> FConsumer>
-    void forEachIndexed(FConsumer consumer) {
-        usize index = 0;
-        for (auto iter = begin; iter != end; ++iter) {
-            consumer(index++, *iter);
-        }
+    bool contains(const K& key) const { return find(key) != entries.end(); }
+
+    usize count(const K& key) const { return contains(key) ? 1 : 0; }
+
+    const V& at(const K& key) const {
+        auto iter = find(key);
+        if (iter == entries.end()) { detail::fail<std::out_of_range>("FlatMap::at: key not found"); }
+        return iter->second;
     }
 
-    template <Reducer<Value, Value> FReducer>
-    Value reduce(FReducer reducer) {
-        auto iter = begin;
-        Value acc = *iter++;
-        for (; iter != end; ++iter) {
-            acc = reducer(acc, *iter);
-        }
-        return acc;
+    bool insert(const value_type& entry) {
+        bool ordered = entries.empty() || compare(entries.back().first, entry.first);
+        auto iter = ordered ? entries.end() : lower_bound(entry.first);
+        if (iter != entries.end() && !compare(entry.first, iter->first)) { return false; }
+        entries.insert(iter, entry);
+        return true;
     }
+};
 
-    template <typename R, Reducer<Value, R> FReducer>
-    R reduce(R init, FReducer reducer) {
-        R result = init;
-        for (auto iter = begin; iter != end; ++iter) {
-            result = reducer(result, *iter);
-        }
-        return result;
+/**
+ * Collections with a `Builder` are collected by gathering everything into the builder
+ * and converting it once at the end, instead of inserting element by element.
+ */
+template <typename T, typename TCompare>
+struct Collection<FlatSet<T, TCompare>>
+{
+    using Value = T;
+    template <typename R>
+    using WithValueType = FlatSet<R>;
+    using Builder = std::vector<T>;
+    static constexpr bool Sorted = std::same_as<TCompare, std::less<T>>;
+
+    static void insert(FlatSet<T, TCompare>& collection, auto value) {
+        collection.insert(value);
     }
 
-    template <Predicate<Value> FPredicate>
-    bool any(FPredicate predicate) {
-        for (auto iter = begin; iter != end; ++iter) {
-            if (predicate(*iter)) { return true; }
-        }
-        return false;
+    static FlatSet<T, TCompare> build(Builder&& values) {
+        return FlatSet<T, TCompare>(std::move(values));
     }
+};
 
-    template <Predicate<Value> FPredicate>
-    bool all(FPredicate predicate) {
-        for (auto iter = begin; iter != end; ++iter) {
-            if (!predicate(*iter)) { return false; }
-        }
-        return true;
+template <typename K, typename V, typename TCompare>
+struct Collection<FlatMap<K, V, TCompare>>
+{
+    using Value = std::pair<K, V>;
+    template <typename R>
+    using WithValueType = std::vector<R>;
+    using Builder = std::vector<std::pair<K, V>>;
+
+    static void insert(FlatMap<K, V, TCompare>& collection, auto value) {
+        collection.insert(value);
     }
 
-    template <typename RCollection>
-    RCollection collect() {
-        RCollection result;
-        for (auto iter = begin; iter != end; ++iter) {
-            Collection<RCollection>::insert(result, *iter);
-        }
-        return result;
+    static FlatMap<K, V, TCompare> build(Builder&& entries) {
+        return FlatMap<K, V, TCompare>(std::move(entries));
     }
 };
 
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    typename R, Mapper<typename TStream::Value, R> FMapper>
-class Map final : public Stream<typename Collection<TCollection>::template WithValueType<R>>
+#if defined(__cpp_lib_flat_set)
+template <typename T, typename TCompare>
+struct Collection<std::flat_set<T, TCompare>>
 {
-  private:
+    using Value = T;
+    template <typename R>
+    using WithValueType = std::flat_set<R>;
+    using Builder = std::vector<T>;
+    static constexpr bool Sorted = std::same_as<TCompare, std::less<T>>;
 
-    using RCollection = typename Collection<TCollection>::template WithValueType<R>;
+    static void insert(std::flat_set<T, TCompare>& collection, auto value) {
+        collection.insert(value);
+    }
 
-    RCollection mapped;
+    static std::flat_set<T, TCompare> build(Builder&& values) {
+        return std::flat_set<T, TCompare>(std::move(values));
+    }
+};
+#endif
 
-    using TIterator = typename TCollection::const_iterator;
+#if defined(__cpp_lib_flat_map)
+template <typename K, typename V, typename TCompare>
+struct Collection<std::flat_map<K, V, TCompare>>
+{
+    using Value = std::pair<K, V>;
+    template <typename R>
+    using WithValueType = std::vector<R>;
+    using Builder = std::vector<std::pair<K, V>>;
 
-    static RCollection map(FMapper mapper, const TIterator& begin, const TIterator& end) {
-        RCollection mapped;
-        for (auto iter = begin; iter != end; ++iter) {
-            Collection<RCollection>::insert(mapped, mapper(*iter));
-        }
-        return mapped;
+    static void insert(std::flat_map<K, V, TCompare>& collection, auto value) {
+        collection.insert(value);
     }
 
-  public:
-
-    explicit Map(
-        FMapper mapper, const TIterator& begin, const TIterator& end
-    ) : Stream<RCollection>(), mapped(map(mapper, begin, end)) {
-        this->begin = mapped.begin();
-        this->end = mapped.end();
+    static std::flat_map<K, V, TCompare> build(Builder&& entries) {
+        std::flat_map<K, V, TCompare> result;
+        result.insert(entries.begin(), entries.end());
+        return result;
     }
 };
+#endif
 
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    Predicate<typename TStream::Value> FPredicate>
-class Filter final : public Stream<TCollection>
+/**
+ * A compressed set of 32-bit integers in the style of a roaring bitmap. Values are grouped
+ * by their upper 16 bits. A group keeps its lower halves as a sorted array while it holds
+ * at most 4096 of them and as a 65536-bit bitset beyond that. Set algebra runs group by
+ * group, word by word on bitsets, and cardinalities come from popcounts.
+ */
+class Bitmap
 {
   private:
 
-    TCollection filtered;
+    static constexpr usize ArrayLimit = 4096;
+    static constexpr usize Words = 65536 / 64;
+    static constexpr uint32_t End = 65536;
 
-    static TCollection filter(
-        FPredicate predicate, const typename Filter::Iterator& begin, const typename Filter::Iterator& end
-    ) {
-        TCollection filtered;
-        for (auto iter = begin; iter != end; ++iter) {
-            if (predicate(*iter)) { Collection<TCollection>::insert(filtered, *iter); }
+    struct Container
+    {
+        // Sorted lower halves while the group is sparse.
+        std::vector<uint16_t> values;
+        // The bitset once it is dense; empty otherwise.
+        std::vector<uint64_t> words;
+        usize cardinality = 0;
+
+        bool dense() const {
+            return !words.empty();
         }
-        return filtered;
-    }
 
-  public:
+        bool contains(uint16_t low) const {
+            if (dense()) { return (words[low >> 6] >> (low & 63)) & 1; }
+            return std::binary_search(values.begin(), values.end(), low);
+        }
 
-    explicit Filter(
-        FPredicate predicate, const typename Filter::Iterator& begin, const typename Filter::Iterator& end
-    ) : Stream<TCollection>(), filtered(filter(predicate, begin, end)) {
-        this->begin = filtered.begin();
-        this->end = filtered.end();
-    }
-};
+        bool insert(uint16_t low) {
+            if (dense()) {
+                uint64_t bit = uint64_t(1) << (low & 63);
+                if (words[low >> 6] & bit) { return false; }
+                words[low >> 6] |= bit;
+            } else {
+                auto iter = values.empty() || values.back() < low
+                    ? values.end() : std::lower_bound(values.begin(), values.end(), low);
+                if (iter != values.end() && *iter == low) { return false; }
+                values.insert(iter, low);
+                if (values.size() > ArrayLimit) { densify(); }
+            }
+            ++cardinality;
+            return true;
+        }
 
-template <Iterable TCollection>
-struct Take final : Stream<TCollection>
-{
-    explicit Take(
-        usize count, const typename Take::Iterator& begin, const typename Take::Iterator& end
-    ) : Stream<TCollection>() {
-        this->begin = begin;
-        auto iter = begin;
-        for (usize i = 0; i < count && iter != end; ++i) { ++iter; }
-        this->end = iter;
-    }
-};
+        void densify() {
+            words.assign(Words, 0);
+            for (uint16_t low : values) { words[low >> 6] |= uint64_t(1) << (low & 63); }
+            values = {};
+        }
 
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    Predicate<typename TStream::Value> FPredicate>
-struct TakeWhile final : Stream<TCollection>
-{
-    explicit TakeWhile(
-        FPredicate predicate, const typename TakeWhile::Iterator& begin, const typename TakeWhile::Iterator& end
-    ) : Stream<TCollection>() {
-        this->begin = begin;
-        for (auto iter = begin; iter != end; ++iter) {
-            if (!predicate(*iter)) {
-                this->end = iter;
+        // Recounts after a bulk change and picks the representation that fits the count.
+        void settle() {
+            if (!dense()) {
+                cardinality = values.size();
+                if (cardinality > ArrayLimit) { densify(); }
                 return;
             }
+            cardinality = 0;
+            for (uint64_t word : words) { cardinality += std::popcount(word); }
+            if (cardinality > ArrayLimit) { return; }
+            values.reserve(cardinality);
+            for (usize i = 0; i < Words; ++i) {
+                for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                    values.push_back(uint16_t(i * 64 + std::countr_zero(word)));
+                }
+            }
+            words = {};
         }
-        this->end = end;
-    }
-};
 
-template <Iterable TCollection>
-struct Skip final : Stream<TCollection>
-{
-    explicit Skip(
-        usize count, const typename Skip::Iterator& begin, const typename Skip::Iterator& end
+        /**
+         * Iteration positions are indices into `values` for arrays and bit numbers for
+         * bitsets. Returns the first position at or after `position` holding a member;
+         * it equals `limit()` when there is none.
+         */
+        uint32_t next(uint32_t position) const {
+            if (!dense() || position >= End) { return position; }
+            usize word = position >> 6;
+            uint64_t bits = words[word] & (~uint64_t(0) << (position & 63));
+            while (bits == 0) {
+                if (++word == Words) { return End; }
+                bits = words[word];
+            }
+            return uint32_t(word * 64 + std::countr_zero(bits));
+        }
+
+        uint32_t limit() const {
+            return dense() ? End : uint32_t(values.size());
+        }
+
+        uint16_t at(uint32_t position) const {
+            return dense() ? uint16_t(position) : values[position];
+        }
+
+        static Container intersect(const Container& a, const Container& b) {
+            Container result;
+            if (a.dense() && b.dense()) {
+                result.words.resize(Words);
+                for (usize i = 0; i < Words; ++i) { result.words[i] = a.words[i] & b.words[i]; }
+            } else if (a.dense() || b.dense()) {
+                const Container& sparse = a.dense() ? b : a;
+                const Container& bitset = a.dense() ? a : b;
+                std::copy_if(sparse.values.begin(), sparse.values.end(), std::back_inserter(result.values), [&](uint16_t low) {
+                    return bitset.contains(low);
+                });
+            } else {
+                std::set_intersection(
+                    a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(result.values)
+                );
+            }
+            result.settle();
+            return result;
+        }
+
+        static Container unite(const Container& a, const Container& b) {
+            Container result;
+            if (!a.dense() && !b.dense()) {
+                std::set_union(
+                    a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(result.values)
+                );
+            } else {
+                const Container& bitset = a.dense() ? a : b;
+                const Container& other = a.dense() ? b : a;
+                result.words = bitset.words;
+                if (other.dense()) {
+                    for (usize i = 0; i < Words; ++i) { result.words[i] |= other.words[i]; }
+                } else {
+                    for (uint16_t low : other.values) { result.words[low >> 6] |= uint64_t(1) << (low & 63); }
+                }
+            }
+            result.settle();
+            return result;
+        }
+
+        static Container subtract(const Container& a, const Container& b) {
+            Container result;
+            if (!a.dense() && !b.dense()) {
+                std::set_difference(
+                    a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(result.values)
+                );
+            } else if (!a.dense()) {
+                std::copy_if(a.values.begin(), a.values.end(), std::back_inserter(result.values), [&](uint16_t low) {
+                    return !b.contains(low);
+                });
+            } else {
+                result.words = a.words;
+                if (b.dense()) {
+                    for (usize i = 0; i < Words; ++i) { result.words[i] &= ~b.words[i]; }
+                } else {
+                    for (uint16_t low : b.values) { result.words[low >> 6] &= ~(uint64_t(1) << (low & 63)); }
+                }
+            }
+            result.settle();
+            return result;
+        }
+    };
+
+    std::vector<uint16_t> keys;
+    std::vector<Container> containers;
+    usize cardinality = 0;
+
+    void append(uint16_t key, Container container) {
+        if (container.cardinality == 0) { return; }
+        cardinality += container.cardinality;
+        keys.push_back(key);
+        containers.push_back(std::move(container));
+    }
+
+    /**
+     * Walks the groups of both bitmaps in key order. Groups present in both go through
+     * `both`; groups present in only one are copied if `keepA` or `keepB` says so.
+     */
+    template <typename FBoth>
+    static Bitmap combine(const Bitmap& a, const Bitmap& b, bool keepA, bool keepB, FBoth both) {
+        Bitmap result;
+        usize i = 0;
+        usize j = 0;
+        while (i < a.keys.size() || j < b.keys.size()) {
+            if (j == b.keys.size() || (i < a.keys.size() && a.keys[i] < b.keys[j])) {
+                if (keepA) { result.append(a.keys[i], a.containers[i]); }
+                ++i;
+            } else if (i == a.keys.size() || b.keys[j] < a.keys[i]) {
+                if (keepB) { result.append(b.keys[j], b.containers[j]); }
+                ++j;
+            } else {
+                result.append(a.keys[i], both(a.containers[i], b.containers[j]));
+                ++i;
+                ++j;
+            }
+        }
+        return result;
+    }
+
+  public:
+
+    using value_type = uint32_t;
+    using size_type = usize;
+
+    class const_iterator
+    {
+      private:
+
+        const Bitmap* bitmap = nullptr;
+        usize container = 0;
+        uint32_t position = 0;
+
+        void settle() {
+            for (; container < bitmap->keys.size(); ++container, position = 0) {
+                position = bitmap->containers[container].next(position);
+                if (position < bitmap->containers[container].limit()) { return; }
+            }
+            position = 0;
+        }
+
+      public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using reference = uint32_t;
+
+        const_iterator() = default;
+
+        const_iterator(const Bitmap* bitmap, usize container) : bitmap(bitmap), container(container) {
+            settle();
+        }
+
+        uint32_t operator*() const {
+            return uint32_t(bitmap->keys[container]) << 16 | bitmap->containers[container].at(position);
+        }
+
+        const Bitmap* source() const { return bitmap; }
+
+        const_iterator& operator++() {
+            ++position;
+            settle();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        friend bool operator==(const const_iterator& a, const const_iterator& b) {
+            return a.container == b.container && a.position == b.position;
+        }
+    };
+
+    using iterator = const_iterator;
+
+    Bitmap() = default;
+
+    // Sorts and deduplicates once, then builds every group in a single step.
+    explicit Bitmap(std::vector<uint32_t> values) {
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        for (usize from = 0, to; from < values.size(); from = to) {
+            uint16_t key = uint16_t(values[from] >> 16);
+            for (to = from + 1; to < values.size() && uint16_t(values[to] >> 16) == key; ++to) {}
+            Container container;
+            container.values.reserve(to - from);
+            for (usize i = from; i < to; ++i) { container.values.push_back(uint16_t(values[i])); }
+            container.settle();
+            append(key, std::move(container));
+        }
+    }
+
+    Bitmap(std::initializer_list<uint32_t> values) : Bitmap(std::vector<uint32_t>(values)) {}
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+
+    const_iterator end() const { return const_iterator(this, keys.size()); }
+
+    usize size() const { return cardinality; }
+
+    bool empty() const { return cardinality == 0; }
+
+    bool contains(uint32_t value) const {
+        auto iter = std::lower_bound(keys.begin(), keys.end(), uint16_t(value >> 16));
+        return iter != keys.end() && *iter == uint16_t(value >> 16)
+            && containers[iter - keys.begin()].contains(uint16_t(value));
+    }
+
+    usize count(uint32_t value) const { return contains(value) ? 1 : 0; }
+
+    // Amortized O(1) when values arrive in ascending order.
+    bool insert(uint32_t value) {
+        uint16_t key = uint16_t(value >> 16);
+        auto iter = keys.empty() || keys.back() < key ? keys.end() : std::lower_bound(keys.begin(), keys.end(), key);
+        usize index = iter - keys.begin();
+        if (iter == keys.end() || *iter != key) {
+            keys.insert(iter, key);
+            containers.insert(containers.begin() + std::ptrdiff_t(index), Container());
+        }
+        if (!containers[index].insert(uint16_t(value))) { return false; }
+        ++cardinality;
+        return true;
+    }
+
+    friend Bitmap operator|(const Bitmap& a, const Bitmap& b) {
+        return combine(a, b, true, true, Container::unite);
+    }
+
+    friend Bitmap operator&(const Bitmap& a, const Bitmap& b) {
+        return combine(a, b, false, false, Container::intersect);
+    }
+
+    friend Bitmap operator-(const Bitmap& a, const Bitmap& b) {
+        return combine(a, b, true, false, Container::subtract);
+    }
+
+    Bitmap& operator|=(const Bitmap& other) { return *this = *this | other; }
+
+    Bitmap& operator&=(const Bitmap& other) { return *this = *this & other; }
+
+    Bitmap& operator-=(const Bitmap& other) { return *this = *this - other; }
+
+    friend bool operator==(const Bitmap& a, const Bitmap& b) {
+        return a.cardinality == b.cardinality && std::equal(a.begin(), a.end(), b.begin(), b.end());
+    }
+};
+
+template <>
+struct Collection<Bitmap>
+{
+    using Value = uint32_t;
+    template <typename R>
+    using WithValueType = std::vector<R>;
+    using Builder = std::vector<uint32_t>;
+    static constexpr bool Sorted = true;
+
+    static void insert(Bitmap& collection, auto value) {
+        collection.insert(value);
+    }
+
+    static Bitmap build(Builder&& values) {
+        return Bitmap(std::move(values));
+    }
+};
+
+namespace detail
+{
+    // The type that arithmetic on `T` accumulates in: 64-bit integers, or at least double.
+    template <typename T>
+    using Wide = std::conditional_t<
+        std::is_floating_point_v<T>, std::common_type_t<T, double>,
+        std::conditional_t<std::is_signed_v<T>, long long, unsigned long long>>;
+}
+
+/**
+ * The arithmetic progression `first, first + step, ...` that stops before `last`. It
+ * holds no elements: iterators compute each value from its index, so ranges of any
+ * length cost nothing to create, measure or index.
+ */
+template <typename T>
+class Range
+{
+  private:
+
+    using Wide = detail::Wide<T>;
+
+    T first;
+    T step;
+    usize length;
+
+    // Iterators index elements with `std::ptrdiff_t`, so longer ranges are rejected.
+    static constexpr usize MaxLength = usize(std::numeric_limits<std::ptrdiff_t>::max());
+
+    static usize measure(T first, T last, T step) {
+        if (step == T(0)) { detail::fail("Range: step must not be zero"); }
+        if (step > T(0) ? !(first < last) : !(last < first)) { return 0; }
+        if constexpr (std::is_floating_point_v<T>) {
+            Wide count = std::ceil((Wide(last) - Wide(first)) / Wide(step));
+            if (!(count < Wide(MaxLength))) { detail::fail<std::length_error>("Range: too many elements"); }
+            return static_cast<usize>(count);
+        } else {
+            // Differences of two's complement values cannot overflow once the operands are
+            // unsigned, and dividing before rounding up keeps large strides from wrapping.
+            using Unsigned = std::make_unsigned_t<Wide>;
+            Unsigned distance = step > T(0) ? Unsigned(Wide(last)) - Unsigned(Wide(first))
+                                            : Unsigned(Wide(first)) - Unsigned(Wide(last));
+            Unsigned stride = step > T(0) ? Unsigned(Wide(step)) : Unsigned(0) - Unsigned(Wide(step));
+            Unsigned count = distance / stride + (distance % stride != 0);
+            if (count > MaxLength) { detail::fail<std::length_error>("Range: too many elements"); }
+            return static_cast<usize>(count);
+        }
+    }
+
+  public:
+
+    using value_type = T;
+
+    class const_iterator
+    {
+      private:
+
+        T first = T();
+        T step = T();
+        std::ptrdiff_t index = 0;
+
+      public:
+
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using reference = T;
+
+        const_iterator() = default;
+
+        const_iterator(T first, T step, std::ptrdiff_t index) : first(first), step(step), index(index) {}
+
+        T operator*() const {
+            if constexpr (std::is_integral_v<T>) {
+                // Wraps in unsigned arithmetic; the result is in range for every index of the range.
+                using Unsigned = std::make_unsigned_t<Wide>;
+                return static_cast<T>(Unsigned(Wide(first)) + Unsigned(index) * Unsigned(Wide(step)));
+            } else {
+                return static_cast<T>(Wide(first) + Wide(index) * Wide(step));
+            }
+        }
+
+        T operator[](difference_type offset) const {
+            return *(*this + offset);
+        }
+
+        const_iterator& operator++() { ++index; return *this; }
+        const_iterator operator++(int) { const_iterator old = *this; ++index; return old; }
+        const_iterator& operator--() { --index; return *this; }
+        const_iterator operator--(int) { const_iterator old = *this; --index; return old; }
+        const_iterator& operator+=(difference_type offset) { index += offset; return *this; }
+        const_iterator& operator-=(difference_type offset) { index -= offset; return *this; }
+
+        friend const_iterator operator+(const_iterator iter, difference_type offset) { return iter += offset; }
+        friend const_iterator operator+(difference_type offset, const_iterator iter) { return iter += offset; }
+        friend const_iterator operator-(const_iterator iter, difference_type offset) { return iter -= offset; }
+        friend difference_type operator-(const const_iterator& a, const const_iterator& b) { return a.index - b.index; }
+
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.index == b.index; }
+        friend auto operator<=>(const const_iterator& a, const const_iterator& b) { return a.index <=> b.index; }
+    };
+
+    using iterator = const_iterator;
+
+    Range(T first, T last, T step = T(1)) : first(first), step(step), length(measure(first, last, step)) {}
+
+    const_iterator begin() const {
+        return const_iterator(first, step, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(first, step, static_cast<std::ptrdiff_t>(length));
+    }
+
+    usize size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    T front() const {
+        return first;
+    }
+
+    T back() const {
+        return *(end() - 1);
+    }
+
+    T stride() const {
+        return step;
+    }
+};
+
+/**
+ * Ranges cannot be inserted into, so stages that materialize their output store it in
+ * `Storage` instead.
+ */
+template <typename T>
+struct Collection<Range<T>>
+{
+    using Value = T;
+    template <typename R>
+    using WithValueType = std::vector<R>;
+    using Storage = std::vector<T>;
+};
+
+namespace detail
+{
+    template <typename TCollection>
+    struct Storage
+    {
+        using Type = TCollection;
+    };
+
+    template <typename TCollection>
+        requires requires { typename Collection<TCollection>::Storage; }
+    struct Storage<TCollection>
+    {
+        using Type = typename Collection<TCollection>::Storage;
+    };
+}
+
+// The collection a stage materializes elements of `TCollection` into.
+template <typename TCollection>
+using StorageOf = typename detail::Storage<TCollection>::Type;
+
+// Sources whose elements are views that are released as reading moves on.
+template <typename TCollection>
+concept TransientSource = requires {
+    requires Collection<TCollection>::Transient;
+};
+
+// True when collecting `TCollection` into `RCollection` would keep views its source releases.
+template <typename TCollection, typename RCollection>
+concept CollectsTransient = TransientSource<TCollection>
+    && std::same_as<typename RCollection::value_type, typename TCollection::value_type>;
+
+// The element type terminals return: an owning copy when the source only lends views.
+template <typename TCollection>
+using OwnedValue = std::conditional_t<
+    TransientSource<TCollection>,
+    typename StorageOf<TCollection>::value_type, typename TCollection::value_type
+>;
+
+template <typename RCollection>
+concept Buildable = requires {
+    typename Collection<RCollection>::Builder;
+};
+
+// Collections that iterate in ascending `operator<` order without duplicates.
+template <typename TCollection>
+concept SortedSet = requires {
+    requires Collection<TCollection>::Sorted;
+};
+
+namespace detail
+{
+    template <typename T>
+    concept Hashable = requires(const T& value) {
+        { std::hash<T>{}(value) } -> std::convertible_to<usize>;
+    };
+
+    // Set operations switch from a linear merge to galloping past this ratio of sizes.
+    constexpr usize GallopSkew = 16;
+
+    enum class SetOp { Union, Intersect, Difference };
+
+    // The bitmap `[begin, end)` spans, or a copy of the slice when it covers only part of one.
+    inline const Bitmap& spannedBitmap(const Bitmap::const_iterator& begin, const Bitmap::const_iterator& end, Bitmap& slice) {
+        const Bitmap* source = begin.source();
+        if (source != nullptr && end.source() == source && begin == source->begin() && end == source->end()) {
+            return *source;
+        }
+        slice = Bitmap(std::vector<uint32_t>(begin, end));
+        return slice;
+    }
+
+    // Set operations between bitmaps run container by container rather than element by element.
+    template <SetOp Op>
+    Bitmap combineBitmaps(
+        const Bitmap::const_iterator& aBegin, const Bitmap::const_iterator& aEnd,
+        const Bitmap::const_iterator& bBegin, const Bitmap::const_iterator& bEnd
+    ) {
+        Bitmap aSlice, bSlice;
+        const Bitmap& a = spannedBitmap(aBegin, aEnd, aSlice);
+        const Bitmap& b = spannedBitmap(bBegin, bEnd, bSlice);
+        if constexpr (Op == SetOp::Union) { return a | b; }
+        else if constexpr (Op == SetOp::Intersect) { return a & b; }
+        else { return a - b; }
+    }
+
+    // `std::lower_bound` over `[first, last)`, probing at doubling distances from `first`.
+    template <typename TIterator, typename T>
+    TIterator gallop(TIterator first, TIterator last, const T& value) {
+        usize step = 1;
+        usize bound = 0;
+        usize size = usize(last - first);
+        while (bound + step < size && first[bound + step - 1] < value) {
+            bound += step;
+            step *= 2;
+        }
+        return std::lower_bound(first + bound, first + std::min(size, bound + step), value);
+    }
+
+    /**
+     * Merges two ascending duplicate-free ranges. When both can be indexed and one is
+     * far smaller, the small side is walked and each of its elements located in the large
+     * side by galloping, so the large side costs only a logarithmic probe per element of
+     * the small one plus the elements copied out of it.
+     */
+    template <SetOp Op, typename T, typename TIterator, typename UIterator>
+    std::vector<T> mergeSorted(TIterator a, TIterator aEnd, usize aSize, UIterator b, UIterator bEnd, usize bSize) {
+        std::vector<T> result;
+        constexpr bool indexed = std::random_access_iterator<TIterator> && std::random_access_iterator<UIterator>;
+        bool skewed = std::min(aSize, bSize) * GallopSkew < std::max(aSize, bSize);
+        if constexpr (indexed) {
+            if (skewed && (Op == SetOp::Intersect || (Op == SetOp::Difference && aSize < bSize))) {
+                // Keep the elements of the small side that are (or are not) in the large one.
+                bool smallA = aSize < bSize;
+                auto emit = [&](auto first, auto last, auto other, auto otherEnd) {
+                    for (; first != last; ++first) {
+                        other = gallop(other, otherEnd, *first);
+                        bool found = other != otherEnd && !(*first < *other);
+                        if (found == (Op == SetOp::Intersect)) { result.push_back(*first); }
+                    }
+                };
+                if (smallA) { emit(a, aEnd, b, bEnd); } else { emit(b, bEnd, a, aEnd); }
+                return result;
+            }
+            if (skewed) {
+                // Copy the large side in runs, splicing in or cutting out the small side.
+                bool smallA = Op == SetOp::Union && aSize < bSize;
+                auto splice = [&](auto first, auto last, auto other, auto otherEnd) {
+                    for (; first != last; ++first) {
+                        auto next = gallop(other, otherEnd, *first);
+                        result.insert(result.end(), other, next);
+                        if (Op == SetOp::Union) { result.push_back(*first); }
+                        other = next != otherEnd && !(*first < *next) ? next + 1 : next;
+                    }
+                    result.insert(result.end(), other, otherEnd);
+                };
+                if (smallA) { splice(a, aEnd, b, bEnd); } else { splice(b, bEnd, a, aEnd); }
+                return result;
+            }
+        }
+        result.reserve(Op == SetOp::Intersect ? std::min(aSize, bSize) : Op == SetOp::Union ? aSize + bSize : aSize);
+        if constexpr (Op == SetOp::Union) {
+            std::set_union(a, aEnd, b, bEnd, std::back_inserter(result));
+        } else if constexpr (Op == SetOp::Intersect) {
+            std::set_intersection(a, aEnd, b, bEnd, std::back_inserter(result));
+        } else {
+            std::set_difference(a, aEnd, b, bEnd, std::back_inserter(result));
+        }
+        return result;
+    }
+
+    // Visits `[iter, end)` as `const T&`, converting elements that are only views of a `T`.
+    template <typename T, typename TIterator, typename FVisitor>
+    void forEachAs(TIterator iter, const TIterator& end, FVisitor visitor) {
+        for (; iter != end; ++iter) {
+            if constexpr (std::convertible_to<std::iter_reference_t<TIterator>, const T&>) {
+                visitor(*iter);
+            } else {
+                visitor(T(*iter));
+            }
+        }
+    }
+
+    // Hashes the right side and keeps each result element once, in encounter order.
+    template <SetOp Op, typename T, typename TIterator, typename UIterator>
+    std::vector<T> hashSets(TIterator a, TIterator aEnd, usize aSize, UIterator b, UIterator bEnd, usize bSize) {
+        std::vector<T> result;
+        std::unordered_set<T> table;
+        auto unite = [&](const T& value) { if (table.insert(value).second) { result.push_back(value); } };
+        if constexpr (Op == SetOp::Union) {
+            table.reserve(aSize + bSize);
+            forEachAs<T>(a, aEnd, unite);
+            forEachAs<T>(b, bEnd, unite);
+        } else {
+            table.reserve(Op == SetOp::Intersect ? bSize : aSize + bSize);
+            forEachAs<T>(b, bEnd, [&](const T& value) { table.insert(value); });
+            forEachAs<T>(a, aEnd, [&](const T& value) {
+                // An intersection erases what it emits; a difference inserts it. Either way
+                // each value is emitted at most once.
+                bool emit = Op == SetOp::Intersect ? table.erase(value) != 0 : table.insert(value).second;
+                if (emit) { result.push_back(value); }
+            });
+        }
+        return result;
+    }
+}
+
+// How `sum(SumMode)` adds up floating-point elements.
+enum class SumMode
+{
+    // Several independent accumulators, which the compiler can vectorize. Parallel
+    // results depend on how the range was chunked.
+    Fast,
+    // Neumaier summation. The error does not grow with the length, at a few times the cost.
+    Compensated,
+    // Pairwise over fixed leaves, so the error grows with the log of the length.
+    Pairwise,
+    // The pairwise tree, evaluated in parallel on fixed blocks so that every thread count
+    // and the sequential stream give bitwise identical results.
+    Deterministic,
+};
+
+namespace detail
+{
+    constexpr usize SumLanes = 8;
+    constexpr usize PairwiseLeaf = 128;
+    // Parallel deterministic sums hand out blocks of 2^5 leaves.
+    constexpr unsigned DeterministicLevels = 5;
+
+    template <typename W>
+    W foldLanes(std::array<W, SumLanes>& lanes) {
+        for (usize width = SumLanes / 2; width != 0; width /= 2) {
+            for (usize lane = 0; lane < width; ++lane) { lanes[lane] += lanes[lane + width]; }
+        }
+        return lanes[0];
+    }
+
+    // Term `i` goes to lane `i % SumLanes`, however the values are reached.
+    template <typename W, typename FTerm>
+    W sumLanesOf(usize count, FTerm term) {
+        std::array<W, SumLanes> lanes {};
+        usize i = 0;
+        for (; i + SumLanes <= count; i += SumLanes) {
+            for (usize lane = 0; lane < SumLanes; ++lane) { lanes[lane] += term(i + lane); }
+        }
+        for (; i < count; ++i) { lanes[i % SumLanes] += term(i); }
+        return foldLanes(lanes);
+    }
+
+    template <typename W, typename TIterator>
+    W sumLanes(TIterator values, usize count) {
+        return sumLanesOf<W>(count, [&](usize i) { return values[i]; });
+    }
+
+    template <typename W>
+    struct Neumaier
+    {
+        W sum = 0;
+        W compensation = 0;
+
+        void add(W value) {
+            W total = sum + value;
+            compensation += std::abs(sum) >= std::abs(value) ? (sum - total) + value : (value - total) + sum;
+            sum = total;
+        }
+
+        void merge(const Neumaier& other) {
+            add(other.sum);
+            compensation += other.compensation;
+        }
+
+        W result() const {
+            return sum + compensation;
+        }
+    };
+
+    /**
+     * Adds leaf sums like a binary counter: two partial sums of the same level merge into
+     * one of the next level. The tree therefore depends only on the number of leaves, and
+     * any aligned run of 2^k leaves forms one of its subtrees.
+     */
+    template <typename W>
+    class Cascade
+    {
+      private:
+
+        std::array<W, std::numeric_limits<usize>::digits + 1> sums;
+        std::array<unsigned, std::numeric_limits<usize>::digits + 1> levels;
+        usize depth = 0;
+
+      public:
+
+        void push(W value, unsigned level = 0) {
+            for (; depth != 0 && levels[depth - 1] == level; ++level) { value = sums[--depth] + value; }
+            sums[depth] = value;
+            levels[depth++] = level;
+        }
+
+        // Continues with the leaves that `other` has seen, as if they had been pushed here.
+        void append(const Cascade& other) {
+            for (usize i = 0; i < other.depth; ++i) { push(other.sums[i], other.levels[i]); }
+        }
+
+        W result() const {
+            if (depth == 0) { return 0; }
+            W total = sums[depth - 1];
+            for (usize i = depth - 1; i != 0; --i) { total = sums[i - 1] + total; }
+            return total;
+        }
+    };
+
+    template <typename W, typename TIterator>
+    void pushLeaves(Cascade<W>& cascade, TIterator values, usize count) {
+        for (usize from = 0; from < count; from += PairwiseLeaf) {
+            cascade.push(sumLanes<W>(values + from, std::min(PairwiseLeaf, count - from)));
+        }
+    }
+
+    /**
+     * Hands `[begin, end)` to `consume(values, count)` in runs of up to `MaskBatch`
+     * elements that can be indexed. Random-access ranges are passed through; others are
+     * copied into a buffer first.
+     */
+    template <typename T, typename TIterator, typename FConsume>
+    void forEachRun(TIterator begin, const TIterator& end, usize length, usize prefetch, FConsume consume) {
+        if constexpr (std::random_access_iterator<TIterator>) {
+            for (usize from = 0; from < length; from += MaskBatch) {
+                consume(begin + from, std::min(MaskBatch, length - from));
+            }
+        } else {
+            std::array<T, MaskBatch> buffer;
+            usize count = 0;
+            traverse(begin, end, prefetch, [&](const T& value) {
+                buffer[count] = value;
+                if (++count == MaskBatch) {
+                    consume(buffer.data(), count);
+                    count = 0;
+                }
+                return true;
+            });
+            if (count != 0) { consume(buffer.data(), count); }
+        }
+    }
+}
+
+/**
+ * Count, sum, extremes, mean and variance of a sequence of numbers, built in one pass
+ * and mergeable across chunks. Runs of values are summarized batch by batch in
+ * vectorizable loops and folded in with Chan's pairwise update; single values use
+ * Welford's update.
+ */
+template <typename T>
+struct SummaryStatistics
+{
+    usize count = 0;
+    detail::Wide<T> sum = 0;
+    T min = std::numeric_limits<T>::max();
+    T max = std::numeric_limits<T>::lowest();
+    double mean = 0;
+    // The sum of squared deviations from the mean.
+    double m2 = 0;
+
+    void accept(T value) {
+        ++count;
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        double delta = double(value) - mean;
+        mean += delta / double(count);
+        m2 += delta * (double(value) - mean);
+    }
+
+    template <std::random_access_iterator TIterator>
+    void accept(TIterator values, usize size) {
+        if (size == 0) { return; }
+        SummaryStatistics batch;
+        batch.count = size;
+        batch.sum = detail::sumLanes<detail::Wide<T>>(values, size);
+        for (usize i = 0; i < size; ++i) {
+            batch.min = values[i] < batch.min ? values[i] : batch.min;
+            batch.max = batch.max < values[i] ? values[i] : batch.max;
+        }
+        batch.mean = double(batch.sum) / double(size);
+        batch.m2 = detail::sumLanesOf<double>(size, [&](usize i) {
+            double deviation = double(values[i]) - batch.mean;
+            return deviation * deviation;
+        });
+        merge(batch);
+    }
+
+    void merge(const SummaryStatistics& other) {
+        if (other.count == 0) { return; }
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        double total = double(count + other.count);
+        double delta = other.mean - mean;
+        mean += delta * double(other.count) / total;
+        m2 += other.m2 + delta * delta * double(count) * double(other.count) / total;
+        count += other.count;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+
+    std::optional<double> average() const {
+        if (count == 0) { return std::nullopt; }
+        return mean;
+    }
+
+    // The population variance.
+    std::optional<double> variance() const {
+        if (count == 0) { return std::nullopt; }
+        return m2 / double(count);
+    }
+
+    std::optional<double> sampleVariance() const {
+        if (count < 2) { return std::nullopt; }
+        return m2 / double(count - 1);
+    }
+
+    std::optional<double> standardDeviation() const {
+        if (count == 0) { return std::nullopt; }
+        return std::sqrt(m2 / double(count));
+    }
+};
+
+/**
+ * Counts of values falling into `bins` equal-width bins over `[lo, hi)`. Values below
+ * `lo` are counted as underflow; values at or above `hi`, and NaN, as overflow.
+ */
+class Histogram
+{
+  private:
+
+    double lo;
+    double hi;
+    double scale;
+    // Slot 0 holds the underflow and the last slot the overflow.
+    std::vector<usize> slots;
+
+    usize slot(double value) const {
+        if (value < lo) { return 0; }
+        if (!(value < hi)) { return slots.size() - 1; }
+        return std::min(usize((value - lo) * scale), slots.size() - 3) + 1;
+    }
+
+  public:
+
+    Histogram(double lo, double hi, usize bins) : lo(lo), hi(hi), scale(0), slots(bins + 2) {
+        if (bins == 0) { detail::fail("Histogram: no bins"); }
+        if (!(lo < hi)) { detail::fail("Histogram: empty interval"); }
+        scale = double(bins) / (hi - lo);
+    }
+
+    template <typename T>
+    void accept(T value) {
+        ++slots[slot(double(value))];
+    }
+
+    // Computes the slots of a run first, so that loop has no stores to the counts.
+    template <std::random_access_iterator TIterator>
+    void accept(TIterator values, usize size) {
+        std::array<uint32_t, detail::MaskBatch> indices;
+        for (usize from = 0; from < size; from += indices.size()) {
+            usize batch = std::min(indices.size(), size - from);
+            for (usize i = 0; i < batch; ++i) { indices[i] = uint32_t(slot(double(values[from + i]))); }
+            for (usize i = 0; i < batch; ++i) { ++slots[indices[i]]; }
+        }
+    }
+
+    void merge(const Histogram& other) {
+        if (other.lo != lo || other.hi != hi || other.slots.size() != slots.size()) {
+            detail::fail("Histogram::merge: different bins");
+        }
+        for (usize i = 0; i < slots.size(); ++i) { slots[i] += other.slots[i]; }
+    }
+
+    usize bins() const {
+        return slots.size() - 2;
+    }
+
+    usize operator[](usize bin) const {
+        return slots[bin + 1];
+    }
+
+    // The inclusive lower edge of `bin`; `lowerEdge(bins())` is `hi`.
+    double lowerEdge(usize bin) const {
+        return bin == bins() ? hi : lo + double(bin) / scale;
+    }
+
+    usize underflow() const {
+        return slots.front();
+    }
+
+    usize overflow() const {
+        return slots.back();
+    }
+
+    usize total() const {
+        return std::accumulate(slots.begin(), slots.end(), usize(0));
+    }
+};
+
+namespace detail
+{
+    using Random = std::mt19937_64;
+
+    // A uniform draw from (0, 1], so its logarithm is finite.
+    inline double uniformOpen(Random& random) {
+        return 1.0 - std::generate_canonical<double, 53>(random);
+    }
+
+    // The number of failures before the next success of a trial with `log1p(-p)` given.
+    inline usize geometricGap(Random& random, double logFailure) {
+        double gap = std::floor(std::log(uniformOpen(random)) / logFailure);
+        return gap < double(std::numeric_limits<usize>::max()) ? usize(gap) : std::numeric_limits<usize>::max();
+    }
+
+    /**
+     * A uniform sample of up to `capacity` elements by Li's Algorithm L. Once the
+     * reservoir is full, the gap to the next element that enters it is drawn directly,
+     * so elements in between cost nothing and are jumped over in O(1) on random-access
+     * iterators. Reservoirs of disjoint parts merge into a sample of their union.
+     */
+    template <typename T>
+    class Reservoir
+    {
+      private:
+
+        usize capacity;
+        std::vector<T> items;
+        usize seen = 0;
+        usize gap = 0;
+        double weight = 1;
+        Random random;
+
+        void draw() {
+            weight *= std::exp(std::log(uniformOpen(random)) / double(capacity));
+            gap = geometricGap(random, std::log1p(-weight));
+        }
+
+      public:
+
+        Reservoir(usize capacity, uint64_t seed) : capacity(capacity), random(seed) {
+            items.reserve(capacity);
+        }
+
+        template <typename TIterator, typename TSentinel>
+        void offer(TIterator iter, const TSentinel& end) {
+            if (capacity == 0) { return; }
+            for (; items.size() < capacity && iter != end; ++iter, ++seen) {
+                items.emplace_back(*iter);
+                if (items.size() == capacity) { draw(); }
+            }
+            using Difference = std::iter_difference_t<TIterator>;
+            while (iter != end) {
+                auto step = Difference(std::min(gap, usize(std::numeric_limits<Difference>::max())));
+                usize moved = usize(step - std::ranges::advance(iter, step, end));
+                seen += moved;
+                gap -= moved;
+                if (gap != 0 || iter == end) { continue; }
+                items[std::uniform_int_distribution<usize>(0, capacity - 1)(random)] = *iter;
+                ++iter;
+                ++seen;
+                draw();
+            }
+        }
+
+        /**
+         * Draws the merged sample one element at a time, from this side or the other with
+         * probability proportional to how many elements each has not yet given up. That
+         * draws without replacement from the union, so the merge stays uniform.
+         */
+        void merge(Reservoir&& other) {
+            std::shuffle(items.begin(), items.end(), random);
+            std::shuffle(other.items.begin(), other.items.end(), random);
+            usize total = seen + other.seen;
+            std::vector<T> merged;
+            merged.reserve(std::min(capacity, total));
+            usize left = seen, right = other.seen, a = 0, b = 0;
+            while (merged.size() < capacity && left + right != 0) {
+                if (std::uniform_int_distribution<usize>(0, left + right - 1)(random) < left) {
+                    merged.push_back(std::move(items[a++]));
+                    --left;
+                } else {
+                    merged.push_back(std::move(other.items[b++]));
+                    --right;
+                }
+            }
+            items = std::move(merged);
+            seen = total;
+        }
+
+        std::vector<T> result() && {
+            return std::move(items);
+        }
+    };
+}
+
+enum class CompareOp { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+namespace detail
+{
+    // How a comparison keeps its operand: as given, or converted to the field's type.
+    template <typename Result, typename Operand>
+    struct StoredOperand
+    {
+        using Type = std::conditional_t<std::is_arithmetic_v<Result>, Result, Operand>;
+    };
+
+    // Numbers compare in their common type, like the builtin operators, so `x < 2.5` on an
+    // `int` field is not narrowed to `x < 2`.
+    template <typename Result, typename Operand>
+        requires std::is_arithmetic_v<Result> && std::is_arithmetic_v<Operand>
+    struct StoredOperand<Result, Operand>
+    {
+        using Type = std::common_type_t<Result, Operand>;
+    };
+
+    // C strings are copied, since the caller's buffer need not outlive the predicate.
+    template <typename Result, typename Operand>
+        requires std::is_pointer_v<Operand> && std::same_as<std::remove_cv_t<std::remove_pointer_t<Operand>>, char>
+    struct StoredOperand<Result, Operand>
+    {
+        using Type = std::string;
+    };
+}
+
+template <typename T>
+class PredicateExpr;
+
+template <typename T>
+class CompiledPredicate;
+
+template <typename T, typename M>
+struct FieldProjection
+{
+    using Result = M;
+
+    M T::* member;
+
+    const M& operator()(const T& value) const { return value.*member; }
+};
+
+template <typename T>
+struct ValueProjection
+{
+    using Result = T;
+
+    const T& operator()(const T& value) const { return value; }
+};
+
+template <typename T, typename TProjection>
+struct Projected
+{
+    TProjection projection;
+
+    template <typename Operand>
+    PredicateExpr<T> compare(CompareOp op, Operand operand) const;
+
+    template <typename Operand>
+    PredicateExpr<T> operator==(Operand operand) const { return compare(CompareOp::Equal, operand); }
+
+    template <typename Operand>
+    PredicateExpr<T> operator!=(Operand operand) const { return compare(CompareOp::NotEqual, operand); }
+
+    template <typename Operand>
+    PredicateExpr<T> operator<(Operand operand) const { return compare(CompareOp::Less, operand); }
+
+    template <typename Operand>
+    PredicateExpr<T> operator<=(Operand operand) const { return compare(CompareOp::LessEqual, operand); }
+
+    template <typename Operand>
+    PredicateExpr<T> operator>(Operand operand) const { return compare(CompareOp::Greater, operand); }
+
+    template <typename Operand>
+    PredicateExpr<T> operator>=(Operand operand) const { return compare(CompareOp::GreaterEqual, operand); }
+};
+
+/**
+ * A predicate over `T` assembled at runtime from comparisons on projected fields,
+ * combined with `&&`, `||` and `!`. Each comparison picks its templated batch kernel
+ * when it is built, so evaluation costs one indirect call per batch instead of one
+ * per element.
+ */
+template <typename T>
+class PredicateExpr
+{
+  public:
+
+    static constexpr usize BatchSize = detail::MaskBatch;
+
+    struct Comparison
+    {
+        virtual ~Comparison() = default;
+        virtual void evaluate(const T* const* batch, usize count, uint8_t* mask) const = 0;
+    };
+
+  private:
+
+    friend class CompiledPredicate<T>;
+
+    enum class Kind { True, Compare, And, Or, Not };
+
+    struct Node
+    {
+        Kind kind;
+        std::shared_ptr<const Comparison> comparison;
+        std::shared_ptr<const Node> lhs;
+        std::shared_ptr<const Node> rhs;
+    };
+
+    std::shared_ptr<const Node> root;
+
+    explicit PredicateExpr(std::shared_ptr<const Node> root) : root(std::move(root)) {}
+
+    static PredicateExpr combine(Kind kind, const PredicateExpr& lhs, const PredicateExpr& rhs) {
+        return PredicateExpr(std::make_shared<const Node>(Node { kind, nullptr, lhs.root, rhs.root }));
+    }
+
+  public:
+
+    PredicateExpr() : root(std::make_shared<const Node>(Node { Kind::True, nullptr, nullptr, nullptr })) {}
+
+    explicit PredicateExpr(std::shared_ptr<const Comparison> comparison)
+        : root(std::make_shared<const Node>(Node { Kind::Compare, std::move(comparison), nullptr, nullptr })) {}
+
+    static PredicateExpr always() { return PredicateExpr(); }
+
+    template <typename M, std::same_as<T> C = T>
+    static auto field(M C::* member) -> Projected<T, FieldProjection<T, M>> {
+        return { FieldProjection<T, M> { member } };
+    }
+
+    static auto value() -> Projected<T, ValueProjection<T>> {
+        return { ValueProjection<T> {} };
+    }
+
+    PredicateExpr operator&&(const PredicateExpr& other) const { return combine(Kind::And, *this, other); }
+
+    PredicateExpr operator||(const PredicateExpr& other) const { return combine(Kind::Or, *this, other); }
+
+    PredicateExpr operator!() const {
+        return PredicateExpr(std::make_shared<const Node>(Node { Kind::Not, nullptr, root, nullptr }));
+    }
+
+    CompiledPredicate<T> compile() const { return CompiledPredicate<T>(*this); }
+};
+
+template <typename T, typename TProjection, typename Operand>
+class ComparisonKernel final : public PredicateExpr<T>::Comparison
+{
+  private:
+
+    using Kernel = void (*)(const TProjection&, const Operand&, const T* const*, usize, uint8_t*);
+
+    // Numeric fields are converted to the operand's common type before comparing.
+    template <typename R>
+    static decltype(auto) promote(const R& value) {
+        if constexpr (std::is_arithmetic_v<R> && std::is_arithmetic_v<Operand>) {
+            return Operand(value);
+        } else {
+            return (value);
+        }
+    }
+
+    template <CompareOp Op>
+    static void kernel(
+        const TProjection& projection, const Operand& operand, const T* const* batch, usize count, uint8_t* mask
+    ) {
+        for (usize i = 0; i < count; ++i) {
+            const auto& projected = projection(*batch[i]);
+            const auto& value = promote(projected);
+            if constexpr (Op == CompareOp::Equal) { mask[i] = value == operand; }
+            if constexpr (Op == CompareOp::NotEqual) { mask[i] = value != operand; }
+            if constexpr (Op == CompareOp::Less) { mask[i] = value < operand; }
+            if constexpr (Op == CompareOp::LessEqual) { mask[i] = value <= operand; }
+            if constexpr (Op == CompareOp::Greater) { mask[i] = value > operand; }
+            if constexpr (Op == CompareOp::GreaterEqual) { mask[i] = value >= operand; }
+        }
+    }
+
+    static Kernel select(CompareOp op) {
+        switch (op) {
+            case CompareOp::Equal: return &kernel<CompareOp::Equal>;
+            case CompareOp::NotEqual: return &kernel<CompareOp::NotEqual>;
+            case CompareOp::Less: return &kernel<CompareOp::Less>;
+            case CompareOp::LessEqual: return &kernel<CompareOp::LessEqual>;
+            case CompareOp::Greater: return &kernel<CompareOp::Greater>;
+            case CompareOp::GreaterEqual: return &kernel<CompareOp::GreaterEqual>;
+        }
+        detail::fail("PredicateExpr: unknown comparison operator");
+    }
+
+    TProjection projection;
+    Operand operand;
+    Kernel selected;
+
+  public:
+
+    ComparisonKernel(TProjection projection, CompareOp op, Operand operand)
+        : projection(projection), operand(operand), selected(select(op)) {}
+
+    void evaluate(const T* const* batch, usize count, uint8_t* mask) const override {
+        selected(projection, operand, batch, count, mask);
+    }
+};
+
+template <typename T, typename TProjection>
+template <typename Operand>
+PredicateExpr<T> Projected<T, TProjection>::compare(CompareOp op, Operand operand) const {
+    using Result = std::remove_cvref_t<typename TProjection::Result>;
+    using Stored = typename detail::StoredOperand<Result, Operand>::Type;
+    return PredicateExpr<T>(
+        std::make_shared<const ComparisonKernel<T, TProjection, Stored>>(projection, op, Stored(operand))
+    );
+}
+
+/**
+ * The flattened, postfix form of a `PredicateExpr`. Evaluation runs each instruction
+ * over a whole batch, keeping intermediate results as byte masks on a small per-thread
+ * stack that is allocated once and reused, so evaluation is safe from several threads.
+ */
+template <typename T>
+class CompiledPredicate
+{
+  private:
+
+    using Expr = PredicateExpr<T>;
+    using Node = typename Expr::Node;
+    using Kind = typename Expr::Kind;
+
+    static constexpr usize BatchSize = Expr::BatchSize;
+
+    struct Instruction
+    {
+        Kind kind;
+        std::shared_ptr<const typename Expr::Comparison> comparison;
+    };
+
+    std::vector<Instruction> program;
+    usize depth = 0;
+
+    static bool isTrue(const std::shared_ptr<const Node>& node) { return node->kind == Kind::True; }
+
+    // Emits `node` in postfix order and returns the stack depth it needs.
+    usize emit(const std::shared_ptr<const Node>& node) {
+        switch (node->kind) {
+            case Kind::True:
+            case Kind::Compare:
+                program.push_back({ node->kind, node->comparison });
+                return 1;
+            case Kind::Not:
+                if (node->lhs->kind == Kind::Not) { return emit(node->lhs->lhs); }
+                {
+                    usize needed = emit(node->lhs);
+                    program.push_back({ Kind::Not, nullptr });
+                    return needed;
+                }
+            case Kind::And:
+            case Kind::Or:
+                if (isTrue(node->lhs)) { return node->kind == Kind::And ? emit(node->rhs) : emit(node->lhs); }
+                if (isTrue(node->rhs)) { return node->kind == Kind::And ? emit(node->lhs) : emit(node->rhs); }
+                {
+                    usize left = emit(node->lhs);
+                    usize right = emit(node->rhs);
+                    program.push_back({ node->kind, nullptr });
+                    return std::max(left, right + 1);
+                }
+        }
+        return 0;
+    }
+
+  public:
+
+    explicit CompiledPredicate(const Expr& expr) {
+        depth = emit(expr.root);
+    }
+
+    void evaluate(const T* const* batch, usize count, uint8_t* mask) const {
+        thread_local std::vector<uint8_t> stack;
+        if (stack.size() < depth * BatchSize) { stack.resize(depth * BatchSize); }
+        usize top = 0;
+        for (const Instruction& instruction : program) {
+            uint8_t* current = stack.data() + top * BatchSize;
+            switch (instruction.kind) {
+                case Kind::True:
+                    std::fill_n(current, count, uint8_t(1));
+                    ++top;
+                    break;
+                case Kind::Compare:
+                    instruction.comparison->evaluate(batch, count, current);
+                    ++top;
+                    break;
+                case Kind::Not: {
+                    uint8_t* operand = current - BatchSize;
+                    for (usize i = 0; i < count; ++i) { operand[i] ^= 1; }
+                    break;
+                }
+                case Kind::And: {
+                    uint8_t* lhs = current - 2 * BatchSize;
+                    const uint8_t* rhs = current - BatchSize;
+                    for (usize i = 0; i < count; ++i) { lhs[i] &= rhs[i]; }
+                    --top;
+                    break;
+                }
+                case Kind::Or: {
+                    uint8_t* lhs = current - 2 * BatchSize;
+                    const uint8_t* rhs = current - BatchSize;
+                    for (usize i = 0; i < count; ++i) { lhs[i] |= rhs[i]; }
+                    --top;
+                    break;
+                }
+            }
+        }
+        std::copy_n(stack.data(), count, mask);
+    }
+
+    bool operator()(const T& value) const {
+        const T* batch[1] = { &value };
+        uint8_t mask[1];
+        evaluate(batch, 1, mask);
+        return mask[0] != 0;
+    }
+};
+
+/**
+ * Where parallel stream work runs. `bulk` runs `task(i)` for every `i` in `[0, count)`
+ * and returns once all of them have finished, rethrowing the first exception raised.
+ */
+class Executor
+{
+  public:
+
+    virtual ~Executor() = default;
+
+    virtual usize concurrency() const = 0;
+
+    virtual void bulk(usize count, const std::function<void(usize)>& task) = 0;
+};
+
+// Runs every task on the calling thread, in order.
+class InlineExecutor final : public Executor
+{
+  public:
+
+    usize concurrency() const override { return 1; }
+
+    void bulk(usize count, const std::function<void(usize)>& task) override {
+        for (usize i = 0; i < count; ++i) { task(i); }
+    }
+};
+
+#if defined(STREAM_HPP_EXECUTION)
+// Runs tasks through a standard execution policy such as `std::execution::par`.
+template <typename TPolicy>
+class PolicyExecutor final : public Executor
+{
+  private:
+
+    TPolicy policy;
+
+  public:
+
+    explicit PolicyExecutor(TPolicy policy = {}) : policy(policy) {}
+
+    usize concurrency() const override {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    void bulk(usize count, const std::function<void(usize)>& task) override {
+        std::vector<usize> indices(count);
+        std::iota(indices.begin(), indices.end(), usize(0));
+        std::for_each(policy, indices.begin(), indices.end(), [&](usize index) { task(index); });
+    }
+};
+#endif
+
+namespace detail
+{
+    /**
+     * A Chase-Lev work-stealing deque of pointers. The owning thread pushes and pops at
+     * the bottom; any other thread may steal from the top. Empty results are `nullptr`.
+     * Buffers replaced by growth are kept until destruction, since a thief may still be
+     * reading one.
+     */
+    template <typename T>
+    class WorkStealingDeque
+    {
+      private:
+
+        struct Buffer
+        {
+            int64_t capacity;
+            std::unique_ptr<std::atomic<T*>[]> slots;
+
+            explicit Buffer(int64_t capacity) : capacity(capacity), slots(new std::atomic<T*>[capacity]) {}
+
+            T* get(int64_t index) const { return slots[index & (capacity - 1)].load(std::memory_order_relaxed); }
+
+            void put(int64_t index, T* value) { slots[index & (capacity - 1)].store(value, std::memory_order_relaxed); }
+        };
+
+        std::atomic<int64_t> top = 0;
+        std::atomic<int64_t> bottom = 0;
+        std::atomic<Buffer*> buffer;
+        std::vector<std::unique_ptr<Buffer>> buffers;
+
+        STREAM_COLD Buffer* grow(Buffer* current, int64_t from, int64_t to) {
+            auto next = std::make_unique<Buffer>(current->capacity * 2);
+            for (int64_t i = from; i < to; ++i) { next->put(i, current->get(i)); }
+            buffers.push_back(std::move(next));
+            return buffers.back().get();
+        }
+
+      public:
+
+        explicit WorkStealingDeque(int64_t capacity = 64) {
+            buffers.push_back(std::make_unique<Buffer>(capacity));
+            buffer.store(buffers.back().get(), std::memory_order_relaxed);
+        }
+
+        void push(T* value) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            Buffer* current = buffer.load(std::memory_order_relaxed);
+            if (b - t > current->capacity - 1) {
+                current = grow(current, t, b);
+                buffer.store(current, std::memory_order_release);
+            }
+            current->put(b, value);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        T* pop() {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Buffer* current = buffer.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            T* value = current->get(b);
+            if (t == b) {
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    value = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return value;
+        }
+
+        bool empty() const {
+            return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+        }
+
+        T* steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) { return nullptr; }
+            T* value = buffer.load(std::memory_order_acquire)->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return value;
+        }
+    };
+}
+
+/**
+ * A fixed set of worker threads, each owning a work-stealing deque. A bulk call is
+ * injected as one index range per worker; whoever picks a range up splits it in half
+ * while its own deque is empty, keeps the lower half and pushes the upper half for idle
+ * workers to steal. A calling thread outside the pool has no deque and splits onto the
+ * injected list instead, so it never keeps a range to itself.
+ * The calling thread helps until its bulk call completes and sleeps while there is
+ * nothing to take, so nested bulk calls made from inside a task cannot deadlock the pool
+ * and a waiting caller does not occupy a core.
+ */
+class WorkStealingPool final : public Executor
+{
+  private:
+
+    struct Job
+    {
+        const std::function<void(usize)>* task;
+        std::atomic<usize> pending;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+    };
+
+    struct Range
+    {
+        Job* job;
+        usize from;
+        usize to;
+    };
+
+    struct Worker
+    {
+        detail::WorkStealingDeque<Range> deque;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Range*> injected;
+    std::atomic<usize> injectedCount = 0;
+    std::atomic<usize> generation = 0;
+    std::atomic<usize> sleepers = 0;
+    bool stopping = false;
+
+    static inline thread_local WorkStealingPool* currentPool = nullptr;
+    static inline thread_local usize currentWorker = 0;
+
+    Worker* self() { return currentPool == this ? workers[currentWorker].get() : nullptr; }
+
+    void notify() {
+        generation.fetch_add(1);
+        if (sleepers.load() != 0) {
+            std::lock_guard lock(mutex);
+            wake.notify_all();
+        }
+    }
+
+    Range* take() {
+        if (Worker* worker = self()) {
+            if (Range* range = worker->deque.pop()) { return range; }
+        }
+        {
+            std::lock_guard lock(mutex);
+            if (!injected.empty()) {
+                Range* range = injected.back();
+                injected.pop_back();
+                injectedCount.store(injected.size(), std::memory_order_relaxed);
+                return range;
+            }
+        }
+        usize start = currentPool == this ? currentWorker + 1 : 0;
+        for (usize i = 0; i < workers.size(); ++i) {
+            if (Range* range = workers[(start + i) % workers.size()]->deque.steal()) { return range; }
+        }
+        return nullptr;
+    }
+
+    void inject(Range* range) {
+        std::lock_guard lock(mutex);
+        injected.push_back(range);
+        injectedCount.store(injected.size(), std::memory_order_relaxed);
+    }
+
+    // Lazy binary splitting: a range is halved only while the worker's own deque, or the
+    // injected list for a caller outside the pool, is empty. That is the case at first and
+    // again whenever others have taken the work.
+    void execute(Range* range) {
+        Worker* worker = self();
+        Job* job = range->job;
+        usize done = 0;
+        while (range->from < range->to) {
+            bool idle = worker != nullptr
+                ? worker->deque.empty()
+                : injectedCount.load(std::memory_order_relaxed) == 0;
+            if (range->to - range->from > 1 && idle) {
+                usize middle = range->from + (range->to - range->from) / 2;
+                Range* upper = new Range { job, middle, range->to };
+                if (worker != nullptr) { worker->deque.push(upper); } else { inject(upper); }
+                range->to = middle;
+                notify();
+                continue;
+            }
+            try {
+                (*job->task)(range->from);
+            } catch (...) {
+                std::lock_guard lock(job->errorMutex);
+                if (!job->error) { job->error = std::current_exception(); }
+            }
+            ++range->from;
+            ++done;
+        }
+        delete range;
+        // The caller may be asleep waiting for the last task; `job` is gone once it wakes.
+        if (job->pending.fetch_sub(done, std::memory_order_acq_rel) == done) { notify(); }
+    }
+
+    void run(usize index) {
+        currentPool = this;
+        currentWorker = index;
+        while (true) {
+            usize seen = generation.load();
+            if (Range* range = take()) {
+                execute(range);
+                continue;
+            }
+            std::unique_lock lock(mutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [&] { return stopping || generation.load() != seen; });
+            sleepers.fetch_sub(1);
+            if (stopping) { return; }
+        }
+    }
+
+  public:
+
+    explicit WorkStealingPool(usize threads = 0) {
+        if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+        for (usize i = 0; i < threads; ++i) { workers.push_back(std::make_unique<Worker>()); }
+        for (usize i = 0; i < threads; ++i) { workers[i]->thread = std::thread([this, i] { run(i); }); }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() override {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (const std::unique_ptr<Worker>& worker : workers) { worker->thread.join(); }
+    }
+
+    // The process-wide pool used by `Stream::parallel` when no executor is given.
+    static WorkStealingPool& shared() {
+        static WorkStealingPool pool;
+        return pool;
+    }
+
+    usize concurrency() const override { return workers.size(); }
+
+    void bulk(usize count, const std::function<void(usize)>& task) override {
+        if (count == 0) { return; }
+        Job job { &task, count, nullptr, {} };
+        usize parts = std::min(count, workers.size());
+        {
+            std::lock_guard lock(mutex);
+            for (usize part = parts; part-- > 0;) {
+                injected.push_back(new Range { &job, count * part / parts, count * (part + 1) / parts });
+            }
+            injectedCount.store(injected.size(), std::memory_order_relaxed);
+        }
+        notify();
+        while (job.pending.load(std::memory_order_acquire) != 0) {
+            usize seen = generation.load();
+            if (Range* range = take()) {
+                execute(range);
+                continue;
+            }
+            std::unique_lock lock(mutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [&] {
+                return job.pending.load(std::memory_order_acquire) == 0 || generation.load() != seen;
+            });
+            sleepers.fetch_sub(1);
+        }
+        if (job.error) { std::rethrow_exception(job.error); }
+    }
+};
+
+template <Iterable TCollection>
+class Stream;
+
+template <Iterable TCollection, typename... TStages>
+class Chain;
+
+template <typename In, typename... TStages>
+class Pipeline;
+
+template <Iterable TCollection, typename R, typename FReducer, typename... TStages>
+class Incremental;
+
+template <typename TAggregate, typename In, typename... TStages>
+class View;
+
+template <Iterable TCollection>
+class ParallelStream;
+
+struct ParallelStats
+{
+    usize grain = 0;
+    double elementNanos = 0;
+    usize sampled = 0;
+    usize workers = 0;
+};
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    typename R, Mapper<typename TStream::Value, R> FMapper>
+class Map;
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    Predicate<typename TStream::Value> FPredicate>
+class Filter;
+
+template <Iterable TCollection>
+class BatchFilter;
+
+template <Iterable TCollection>
+class Sample;
+
+template <Iterable TCollection>
+class Combined;
+
+template <Iterable TCollection>
+struct Take;
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    Predicate<typename TStream::Value> FPredicate>
+struct TakeWhile;
+
+template <Iterable TCollection>
+struct Skip;
+
+template <Iterable TCollection>
+struct Prefetch;
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    Predicate<typename TStream::Value> FPredicate>
+struct SkipWhile;
+
+template <Iterable TCollection>
+class Stream
+{
+    template <Iterable> friend class Stream;
+
+  protected:
+
+    using Iterator = typename TCollection::const_iterator;
+
+    // The length of sources that cannot tell it without reading all of their input.
+    static constexpr usize UnknownLength = std::numeric_limits<usize>::max();
+
+    Iterator begin;
+    Iterator end;
+    mutable usize length = 0;
+    usize prefetchDistance = 0;
+    // Keeps alive whatever `begin` and `end` point into when a stage owns it.
+    std::shared_ptr<const void> owner;
+
+    Stream() = default;
+
+    // Iterates over `collection` from now on; copies of this stream share it.
+    void own(TCollection&& collection) {
+        auto owned = std::make_shared<const TCollection>(std::move(collection));
+        begin = owned->begin();
+        end = owned->end();
+        length = owned->size();
+        owner = std::move(owned);
+    }
+
+    // Hands the owner of this stream's range on to a stage that views the same range.
+    template <typename TStage>
+    TStage share(TStage stage) const {
+        stage.owner = owner;
+        return stage;
+    }
+
+    template <typename FVisitor>
+    bool visit(FVisitor&& visitor) const {
+        return detail::traverse(begin, end, prefetchDistance, visitor);
+    }
+
+    template <typename FFormatter, typename FSink>
+    void writeLinesTo(FFormatter& formatter, FSink sink) {
+        detail::LineWriter<FSink> writer(std::move(sink));
+        visit([&](const Value& value) {
+            writer.write(formatter, value);
+            return true;
+        });
+        writer.flush();
+    }
+
+    usize measuredLength() const {
+        if (length == UnknownLength) { length = usize(std::ranges::distance(begin, end)); }
+        return length;
+    }
+
+    template <detail::SetOp Op, Iterable UCollection>
+        requires std::same_as<typename UCollection::value_type, typename TCollection::value_type>
+    auto combine(const Stream<UCollection>& other) const {
+        using T = OwnedValue<TCollection>;
+        if constexpr (std::same_as<TCollection, Bitmap> && std::same_as<UCollection, Bitmap>) {
+            return Combined<Bitmap>(detail::combineBitmaps<Op>(begin, end, other.begin, other.end));
+        } else if constexpr (SortedSet<TCollection> && SortedSet<UCollection>) {
+            return Combined<FlatSet<T>>(FlatSet<T>(detail::mergeSorted<Op, T>(
+                begin, end, measuredLength(), other.begin, other.end, other.measuredLength()
+            )));
+        } else if constexpr (detail::Hashable<T>) {
+            return Combined<std::vector<T>>(detail::hashSets<Op, T>(
+                begin, end, measuredLength(), other.begin, other.end, other.measuredLength()
+            ));
+        } else {
+            FlatSet<T> a(std::vector<T>(begin, end));
+            FlatSet<T> b(std::vector<T>(other.begin, other.end));
+            return Combined<FlatSet<T>>(FlatSet<T>(detail::mergeSorted<Op, T>(
+                a.begin(), a.end(), a.size(), b.begin(), b.end(), b.size()
+            )));
+        }
+    }
+
+    /**
+     * Classifies contiguous elements, counts each class, then copies every element into
+     * an output reserved to its exact size. Classes are kept in the narrowest `Index` that
+     * holds them, so for small elements they do not take more memory than the input.
+     */
+    template <typename Index, typename RCollection, typename FClassifier>
+    void scatter(FClassifier& classifier, std::vector<RCollection>& result) const {
+        const auto* values = std::to_address(begin);
+        std::unique_ptr<Index[]> classes = std::make_unique_for_overwrite<Index[]>(length);
+        std::vector<usize> sizes(result.size());
+        for (usize i = 0; i < length; ++i) {
+            usize index = classifier(values[i]);
+            if (index >= result.size()) { detail::fail<std::out_of_range>("Stream::split: class out of range"); }
+            classes[i] = Index(index);
+            ++sizes[index];
+        }
+        for (usize i = 0; i < result.size(); ++i) { result[i].reserve(sizes[i]); }
+        for (usize i = 0; i < length; ++i) { result[classes[i]].push_back(values[i]); }
+    }
+
+  public:
+
+    using Value = typename TCollection::value_type;
+    // What terminals hand out; lines of an input stream are copied out of its blocks.
+    using Owned = OwnedValue<TCollection>;
+
+    // Unsized sources such as `std::forward_list` are only measured once a terminal needs it.
+    explicit Stream(TCollection& collection)
+        : begin(collection.begin()), end(collection.end()), length(UnknownLength) {
+        if constexpr (std::ranges::sized_range<TCollection>) { length = usize(std::ranges::size(collection)); }
+    }
+
+    template <typename R, Mapper<Value, R> FMapper>
+    auto map(FMapper mapper) -> Map<TCollection, Stream, R, FMapper> {
+        return Map<TCollection, Stream, R, FMapper>(mapper, begin, end, prefetchDistance);
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto filter(FPredicate predicate) -> Filter<TCollection, Stream, FPredicate> {
+        return Filter<TCollection, Stream, FPredicate>(predicate, begin, end, prefetchDistance);
+    }
+
+    auto filter(const CompiledPredicate<Value>& predicate) -> BatchFilter<TCollection> {
+        return BatchFilter<TCollection>(predicate, begin, end, prefetchDistance);
+    }
+
+    auto filter(const PredicateExpr<Value>& expr) -> BatchFilter<TCollection> {
+        return BatchFilter<TCollection>(expr.compile(), begin, end, prefetchDistance);
+    }
+
+    /**
+     * Keeps each element independently with probability `fraction`. The gaps between kept
+     * elements are drawn from a geometric distribution, so the generator runs once per
+     * kept element and random-access sources jump over the rest in O(1).
+     */
+    auto sample(double fraction, uint64_t seed = std::random_device {}()) -> Sample<TCollection> {
+        if (!(fraction >= 0 && fraction <= 1)) {
+            detail::fail<std::invalid_argument>("Stream::sample: fraction out of [0, 1]");
+        }
+        return Sample<TCollection>(fraction, seed, begin, end);
+    }
+
+    // A uniform sample of `k` elements, or all of them if there are fewer, in no particular order.
+    std::vector<Owned> reservoirSample(usize k, uint64_t seed = std::random_device {}()) const {
+        detail::Reservoir<Owned> reservoir(k, seed);
+        reservoir.offer(begin, end);
+        return std::move(reservoir).result();
+    }
+
+    auto take(usize count) -> Take<TCollection> {
+        return share(Take<TCollection>(count, begin, end));
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto takeWhile(FPredicate predicate) -> TakeWhile<TCollection, Stream, FPredicate> {
+        return share(TakeWhile<TCollection, Stream, FPredicate>(predicate, begin, end));
+    }
+
+    auto skip(usize count) -> Skip<TCollection> {
+        return share(Skip<TCollection>(count, length, begin, end));
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto skipWhile(FPredicate predicate) -> SkipWhile<TCollection, Stream, FPredicate> {
+        return share(SkipWhile<TCollection, Stream, FPredicate>(predicate, length, begin, end));
+    }
+
+    /**
+     * Prefetches `distance` elements ahead, or the objects they point to for pointer
+     * elements, in the stages and terminal applied directly to the returned stream.
+     */
+    auto prefetch(usize distance) -> Prefetch<TCollection> {
+        return share(Prefetch<TCollection>(distance, length, begin, end));
+    }
+
+    auto lazy() const -> Chain<TCollection> {
+        return Chain<TCollection>(begin, end, {}, owner);
+    }
+
+    // Runs on the shared work-stealing pool. Passing zero uses all of its workers.
+    auto parallel(usize threads = 0) const -> ParallelStream<TCollection>
+        requires std::random_access_iterator<Iterator>
+    {
+        return ParallelStream<TCollection>(begin, length, WorkStealingPool::shared(), threads, owner);
+    }
+
+    auto parallel(Executor& executor, usize threads = 0) const -> ParallelStream<TCollection>
+        requires std::random_access_iterator<Iterator>
+    {
+        return ParallelStream<TCollection>(begin, length, executor, threads, owner);
+    }
+
+    template <Consumer<const Value&> FConsumer>
+    void forEach(FConsumer consumer) {
+        visit([&](const Value& value) {
+            consumer(value);
+            return true;
+        });
+    }
+
+    template <KeyValueConsumer<usize, const Value&> FConsumer>
+    void forEachIndexed(FConsumer consumer) {
+        usize index = 0;
+        visit([&](const Value& value) {
+            consumer(index++, value);
+            return true;
+        });
+    }
+
+    // The emptiness check happens once up front, so the loop itself stays branch-free.
+    template <Reducer<Value, Value> FReducer>
+    std::optional<Owned> reduce(FReducer reducer) {
+        if (begin == end) { return std::nullopt; }
+        Owned acc(*begin);
+        detail::traverse(std::next(begin), end, prefetchDistance, [&](const Value& value) {
+            acc = reducer(acc, value);
+            return true;
+        });
+        return acc;
+    }
+
+    template <typename R, Reducer<Value, R> FReducer>
+    R reduce(R init, FReducer reducer) {
+        R result = init;
+        visit([&](const Value& value) {
+            result = reducer(result, value);
+            return true;
+        });
+        return result;
+    }
+
+    std::optional<Owned> findFirst() {
+        if (begin == end) { return std::nullopt; }
+        return std::optional<Owned>(std::in_place, *begin);
+    }
+
+    template <Predicate<Value> FPredicate>
+    std::optional<Owned> findFirst(FPredicate predicate) {
+        std::optional<Owned> found;
+        visit([&](const Value& value) {
+            if (!predicate(value)) { return true; }
+            found.emplace(value);
+            return false;
+        });
+        return found;
+    }
+
+    std::optional<Owned> findAny() {
+        return findFirst();
+    }
+
+    template <Predicate<Value> FPredicate>
+    std::optional<Owned> findAny(FPredicate predicate) {
+        return findFirst(predicate);
+    }
+
+    template <Comparator<Value> FComparator = std::less<Value>>
+    std::optional<Owned> min(FComparator comparator = {}) {
+        return reduce([&](const Value& acc, const Value& value) { return comparator(value, acc) ? value : acc; });
+    }
+
+    template <Comparator<Value> FComparator = std::less<Value>>
+    std::optional<Owned> max(FComparator comparator = {}) {
+        return reduce([&](const Value& acc, const Value& value) { return comparator(acc, value) ? value : acc; });
+    }
+
+    // Every stage knows how many elements it yields, so this only traverses input sources.
+    usize count() const {
+        return measuredLength();
+    }
+
+    template <Predicate<Value> FPredicate>
+    usize count(FPredicate predicate) {
+        if constexpr (std::is_arithmetic_v<Value> && std::contiguous_iterator<Iterator>) {
+            const Value* values = std::to_address(begin);
+            std::array<uint8_t, detail::MaskBatch> mask;
+            usize result = 0;
+            for (usize offset = 0; offset < length; offset += detail::MaskBatch) {
+                usize batch = std::min(detail::MaskBatch, length - offset);
+                for (usize i = 0; i < batch; ++i) { mask[i] = predicate(values[offset + i]); }
+                result += detail::countMask(mask.data(), batch);
+            }
+            return result;
+        } else {
+            usize result = 0;
+            visit([&](const Value& value) {
+                result += predicate(value) ? 1 : 0;
+                return true;
+            });
+            return result;
+        }
+    }
+
+    usize count(const CompiledPredicate<Value>& predicate) {
+        std::array<uint8_t, detail::MaskBatch> mask;
+        usize result = 0;
+        detail::forEachBatch<Value>(begin, end, prefetchDistance, [&](const Value* const* batch, usize size) {
+            predicate.evaluate(batch, size, mask.data());
+            result += detail::countMask(mask.data(), size);
+        });
+        return result;
+    }
+
+    usize count(const PredicateExpr<Value>& expr) {
+        return count(expr.compile());
+    }
+
+    // Integers accumulate in 64 bits and floats in at least double precision.
+    auto sum() requires detail::Number<Value> {
+        detail::Wide<Value> result = 0;
+        visit([&](Value value) {
+            result += value;
+            return true;
+        });
+        return result;
+    }
+
+    auto sum(SumMode mode) requires std::floating_point<Value> {
+        using Wide = detail::Wide<Value>;
+        switch (mode) {
+            case SumMode::Fast: {
+                if constexpr (std::contiguous_iterator<Iterator>) {
+                    return detail::sumLanes<Wide>(std::to_address(begin), length);
+                } else {
+                    // Same lane for every element as `sumLanes`, so both paths agree bitwise.
+                    std::array<Wide, detail::SumLanes> lanes {};
+                    usize index = 0;
+                    visit([&](Value value) {
+                        lanes[index++ % detail::SumLanes] += value;
+                        return true;
+                    });
+                    return detail::foldLanes(lanes);
+                }
+            }
+            case SumMode::Compensated: {
+                detail::Neumaier<Wide> total;
+                visit([&](Value value) {
+                    total.add(value);
+                    return true;
+                });
+                return total.result();
+            }
+            case SumMode::Pairwise:
+            case SumMode::Deterministic: {
+                detail::Cascade<Wide> cascade;
+                if constexpr (std::contiguous_iterator<Iterator>) {
+                    detail::pushLeaves(cascade, std::to_address(begin), length);
+                } else {
+                    std::array<Wide, detail::SumLanes> lanes {};
+                    usize filled = 0;
+                    visit([&](Value value) {
+                        lanes[filled % detail::SumLanes] += value;
+                        if (++filled == detail::PairwiseLeaf) {
+                            cascade.push(detail::foldLanes(lanes));
+                            lanes = {};
+                            filled = 0;
+                        }
+                        return true;
+                    });
+                    if (filled != 0) { cascade.push(detail::foldLanes(lanes)); }
+                }
+                return cascade.result();
+            }
+        }
+        detail::fail("Stream::sum: unknown mode");
+    }
+
+    std::optional<double> average() requires detail::Number<Value> {
+        if (measuredLength() == 0) { return std::nullopt; }
+        return static_cast<double>(sum()) / static_cast<double>(length);
+    }
+
+    SummaryStatistics<Value> summaryStatistics() requires detail::Number<Value> {
+        SummaryStatistics<Value> statistics;
+        detail::forEachRun<Value>(begin, end, length, prefetchDistance, [&](auto values, usize count) {
+            statistics.accept(values, count);
+        });
+        return statistics;
+    }
+
+    Histogram histogram(double lo, double hi, usize bins) requires detail::Number<Value> {
+        Histogram result(lo, hi, bins);
+        detail::forEachRun<Value>(begin, end, length, prefetchDistance, [&](auto values, usize count) {
+            result.accept(values, count);
+        });
+        return result;
+    }
+
+    /**
+     * The distinct elements in either stream. Streams over sorted sets (`std::set`,
+     * `FlatSet`, `Bitmap`) are merged, galloping through the larger one when their sizes
+     * are skewed, and the result stays sorted; two `Bitmap` streams yield a `Bitmap`,
+     * combined a container at a time. Other streams are hashed and keep encounter
+     * order; elements that are not hashable are sorted first.
+     */
+    template <Iterable UCollection>
+    auto unionWith(const Stream<UCollection>& other) const {
+        return combine<detail::SetOp::Union>(other);
+    }
+
+    // The distinct elements of this stream that also occur in `other`; see `unionWith`.
+    template <Iterable UCollection>
+    auto intersectWith(const Stream<UCollection>& other) const {
+        return combine<detail::SetOp::Intersect>(other);
+    }
+
+    // The distinct elements of this stream that do not occur in `other`; see `unionWith`.
+    template <Iterable UCollection>
+    auto differenceWith(const Stream<UCollection>& other) const {
+        return combine<detail::SetOp::Difference>(other);
+    }
+
+    template <Predicate<Value> FPredicate>
+    bool any(FPredicate predicate) {
+        return !visit([&](const Value& value) { return !predicate(value); });
+    }
+
+    template <Predicate<Value> FPredicate>
+    bool all(FPredicate predicate) {
+        return visit([&](const Value& value) { return predicate(value); });
+    }
+
+    /**
+     * Splits the stream into the elements that satisfy `predicate` and those that do not.
+     * Contiguous arithmetic streams collected into vectors record the predicate in a byte
+     * mask first, so both outputs are sized exactly, then copy a batch at a time, writing
+     * every element to both sides and advancing only the matching cursor, so the loop has
+     * no data-dependent branch.
+     */
+    template <typename RCollection = std::vector<Owned>, Predicate<Value> FPredicate>
+        requires (!CollectsTransient<TCollection, RCollection>)
+    std::pair<RCollection, RCollection> partition(FPredicate predicate) {
+        std::pair<RCollection, RCollection> result;
+        auto& [accepted, rejected] = result;
+        if constexpr (
+            std::same_as<RCollection, std::vector<Value>>
+            && std::is_arithmetic_v<Value> && std::contiguous_iterator<Iterator>
+        ) {
+            const Value* values = std::to_address(begin);
+            std::unique_ptr<uint8_t[]> mask = std::make_unique_for_overwrite<uint8_t[]>(length);
+            for (usize i = 0; i < length; ++i) { mask[i] = predicate(values[i]); }
+            usize matched = detail::countMask(mask.get(), length);
+            accepted.reserve(matched);
+            rejected.reserve(length - matched);
+            std::array<Value, detail::MaskBatch> hits;
+            std::array<Value, detail::MaskBatch> misses;
+            for (usize from = 0; from < length; from += detail::MaskBatch) {
+                usize count = std::min(detail::MaskBatch, length - from);
+                usize taken = 0;
+                usize left = 0;
+                for (usize i = 0; i < count; ++i) {
+                    hits[taken] = values[from + i];
+                    misses[left] = values[from + i];
+                    taken += mask[from + i];
+                    left += !mask[from + i];
+                }
+                accepted.insert(accepted.end(), hits.begin(), hits.begin() + std::ptrdiff_t(taken));
+                rejected.insert(rejected.end(), misses.begin(), misses.begin() + std::ptrdiff_t(left));
+            }
+        } else {
+            // Half each, so the two outputs never hold twice the input; a lopsided split regrows one side.
+            if constexpr (requires { accepted.reserve(length); }) {
+                if (length != UnknownLength) {
+                    accepted.reserve(length / 2 + 1);
+                    rejected.reserve(length / 2 + 1);
+                }
+            }
+            visit([&](const Value& value) {
+                Collection<RCollection>::insert(predicate(value) ? accepted : rejected, value);
+                return true;
+            });
+        }
+        return result;
+    }
+
+    /**
+     * Routes every element in one pass into output `classifier(value)` of `outputs`.
+     * Vector outputs over contiguous streams are sized exactly: classes are computed
+     * and counted first, then elements are scattered into place; see `scatter`.
+     */
+    template <typename RCollection = std::vector<Owned>, Mapper<Value, usize> FClassifier>
+        requires (!CollectsTransient<TCollection, RCollection>)
+    std::vector<RCollection> split(FClassifier classifier, usize outputs) {
+        if (outputs == 0) { detail::fail("Stream::split: no outputs"); }
+        std::vector<RCollection> result(outputs);
+        if constexpr (std::same_as<RCollection, std::vector<Value>> && std::contiguous_iterator<Iterator>) {
+            if (outputs <= std::numeric_limits<uint8_t>::max() + usize(1)) {
+                scatter<uint8_t>(classifier, result);
+            } else if (outputs <= std::numeric_limits<uint16_t>::max() + usize(1)) {
+                scatter<uint16_t>(classifier, result);
+            } else {
+                scatter<usize>(classifier, result);
+            }
+        } else {
+            visit([&](const Value& value) {
+                usize index = classifier(value);
+                if (index >= outputs) { detail::fail<std::out_of_range>("Stream::split: class out of range"); }
+                Collection<RCollection>::insert(result[index], value);
+                return true;
+            });
+        }
+        return result;
+    }
+
+    /**
+     * Concatenates the elements into one string allocated exactly once. The size comes
+     * from a first pass over text elements; numbers are formatted with `std::to_chars`
+     * straight into a buffer reserved for the longest possible rendering. `char` elements
+     * are written as characters, so a stream over a string joins back into it.
+     */
+    std::string joining(std::string_view separator = "", std::string_view prefix = "", std::string_view suffix = "")
+        requires detail::Text<Value> || detail::Number<Value>
+    {
+        usize separators = measuredLength() > 0 ? (length - 1) * separator.size() : 0;
+        usize bound = prefix.size() + separators + suffix.size();
+        if constexpr (detail::Text<Value>) {
+            visit([&](const Value& value) {
+                bound += std::string_view(value).size();
+                return true;
+            });
+        } else if constexpr (detail::Character<Value>) {
+            bound += length;
+        } else {
+            bound += length * detail::maxChars<Value>();
+        }
+        std::string result;
+        result.reserve(bound);
+        result.append(prefix);
+        bool first = true;
+        visit([&](const Value& value) {
+            if (!first) { result.append(separator); }
+            first = false;
+            detail::appendText(result, value);
+            return true;
+        });
+        result.append(suffix);
+        return result;
+    }
+
+    /**
+     * Writes every element on a line of its own. `formatter` returns the text, character
+     * or number to write, numbers going through `std::to_chars`, or appends the line
+     * itself to the `std::string&` it is given. Lines are gathered in a 64 KiB buffer that is written
+     * whole, and `output` is flushed once at the end.
+     */
+    template <detail::LineFormatter<Value> FFormatter = std::identity>
+    void writeLines(std::ostream& output, FFormatter formatter = {}) {
+        writeLinesTo(formatter, [&](const char* data, usize size) {
+            if (!output.write(data, std::streamsize(size))) {
+                detail::fail<std::ios_base::failure>("Stream::writeLines: write failed");
+            }
+        });
+        output.flush();
+    }
+
+#if __has_include(<unistd.h>)
+    // As above, straight to a file descriptor with no stream buffer in between.
+    template <detail::LineFormatter<Value> FFormatter = std::identity>
+    void writeLines(int fd, FFormatter formatter = {}) {
+        writeLinesTo(formatter, detail::DescriptorSink { fd });
+    }
+#endif
+
+    template <typename RCollection>
+    RCollection collect() requires (!CollectsTransient<TCollection, RCollection>) {
+        if constexpr (Buildable<RCollection>) {
+            using Builder = typename Collection<RCollection>::Builder;
+            return Collection<RCollection>::build(collect<Builder>());
+        } else if constexpr (
+            std::same_as<RCollection, std::vector<Value>>
+            && std::is_trivially_copyable_v<Value> && std::contiguous_iterator<Iterator>
+        ) {
+            RCollection result(static_cast<usize>(end - begin));
+            detail::copyBytes(result.data(), std::to_address(begin), result.size() * sizeof(Value));
+            return result;
+        } else {
+            RCollection result;
+            visit([&](const Value& value) {
+                Collection<RCollection>::insert(result, value);
+                return true;
+            });
+            return result;
+        }
+    }
+};
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    typename R, Mapper<typename TStream::Value, R> FMapper>
+class Map final : public Stream<typename Collection<TCollection>::template WithValueType<R>>
+{
+  private:
+
+    using RCollection = typename Collection<TCollection>::template WithValueType<R>;
+
+    using TIterator = typename TCollection::const_iterator;
+
+    static RCollection map(FMapper mapper, const TIterator& begin, const TIterator& end, usize prefetch) {
+        if constexpr (Buildable<RCollection>) {
+            typename Collection<RCollection>::Builder mapped;
+            detail::traverse(begin, end, prefetch, [&](const auto& value) {
+                Collection<decltype(mapped)>::insert(mapped, mapper(value));
+                return true;
+            });
+            return Collection<RCollection>::build(std::move(mapped));
+        } else {
+            RCollection mapped;
+            detail::traverse(begin, end, prefetch, [&](const auto& value) {
+                Collection<RCollection>::insert(mapped, mapper(value));
+                return true;
+            });
+            return mapped;
+        }
+    }
+
+  public:
+
+    explicit Map(
+        FMapper mapper, const TIterator& begin, const TIterator& end, usize prefetch
+    ) : Stream<RCollection>() {
+        this->own(map(mapper, begin, end, prefetch));
+    }
+};
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    Predicate<typename TStream::Value> FPredicate>
+class Filter final : public Stream<StorageOf<TCollection>>
+{
+  private:
+
+    using RCollection = StorageOf<TCollection>;
+
+    using TIterator = typename TCollection::const_iterator;
+
+    static RCollection filter(FPredicate predicate, const TIterator& begin, const TIterator& end, usize prefetch) {
+        RCollection filtered;
+        detail::traverse(begin, end, prefetch, [&](const auto& value) {
+            if (predicate(value)) { Collection<RCollection>::insert(filtered, value); }
+            return true;
+        });
+        return filtered;
+    }
+
+  public:
+
+    explicit Filter(
+        FPredicate predicate, const TIterator& begin, const TIterator& end, usize prefetch
+    ) : Stream<RCollection>() {
+        this->own(filter(predicate, begin, end, prefetch));
+    }
+};
+
+template <Iterable TCollection>
+class BatchFilter final : public Stream<StorageOf<TCollection>>
+{
+  private:
+
+    using Value = typename TCollection::value_type;
+
+    using RCollection = StorageOf<TCollection>;
+
+    using TIterator = typename TCollection::const_iterator;
+
+    static RCollection filter(
+        const CompiledPredicate<Value>& predicate, const TIterator& begin, const TIterator& end, usize prefetch
+    ) {
+        RCollection filtered;
+        std::array<uint8_t, detail::MaskBatch> mask;
+        detail::forEachBatch<Value>(begin, end, prefetch, [&](const Value* const* batch, usize count) {
+            predicate.evaluate(batch, count, mask.data());
+            for (usize i = 0; i < count; ++i) {
+                if (mask[i]) { Collection<RCollection>::insert(filtered, *batch[i]); }
+            }
+        });
+        return filtered;
+    }
+
+  public:
+
+    explicit BatchFilter(
+        const CompiledPredicate<Value>& predicate, const TIterator& begin, const TIterator& end, usize prefetch
+    ) : Stream<RCollection>() {
+        this->own(filter(predicate, begin, end, prefetch));
+    }
+};
+
+template <Iterable TCollection>
+class Sample final : public Stream<StorageOf<TCollection>>
+{
+  private:
+
+    using RCollection = StorageOf<TCollection>;
+    using TIterator = typename TCollection::const_iterator;
+    using Difference = std::iter_difference_t<TIterator>;
+
+    static RCollection sample(double fraction, uint64_t seed, TIterator begin, const TIterator& end) {
+        RCollection sampled;
+        if (fraction == 0) { return sampled; }
+        detail::Random random(seed);
+        double logFailure = std::log1p(-fraction);
+        while (begin != end) {
+            usize gap = detail::geometricGap(random, logFailure);
+            while (gap != 0 && begin != end) {
+                auto step = Difference(std::min(gap, usize(std::numeric_limits<Difference>::max())));
+                gap -= usize(step - std::ranges::advance(begin, step, end));
+            }
+            if (begin == end) { break; }
+            Collection<RCollection>::insert(sampled, *begin);
+            ++begin;
+        }
+        return sampled;
+    }
+
+  public:
+
+    explicit Sample(double fraction, uint64_t seed, const TIterator& begin, const TIterator& end)
+        : Stream<RCollection>() {
+        this->own(sample(fraction, seed, begin, end));
+    }
+};
+
+// Owns the result of a set operation between two streams.
+template <Iterable TCollection>
+class Combined final : public Stream<TCollection>
+{
+  public:
+
+    explicit Combined(TCollection&& values) : Stream<TCollection>() {
+        this->own(std::move(values));
+    }
+};
+
+template <Iterable TCollection>
+struct Take final : Stream<TCollection>
+{
+    explicit Take(usize count, const typename Take::Iterator& begin, const typename Take::Iterator& end)
+        : Stream<TCollection>() {
+        using Difference = std::iter_difference_t<typename Take::Iterator>;
+        Difference wanted = Difference(std::min<usize>(count, std::numeric_limits<Difference>::max()));
+        this->begin = begin;
+        this->end = begin;
+        // Stops early at `end`, which also measures sources of unknown length.
+        this->length = usize(wanted - std::ranges::advance(this->end, wanted, end));
+    }
+};
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    Predicate<typename TStream::Value> FPredicate>
+struct TakeWhile final : Stream<TCollection>
+{
+    explicit TakeWhile(
+        FPredicate predicate, const typename TakeWhile::Iterator& begin, const typename TakeWhile::Iterator& end
+    ) : Stream<TCollection>() {
+        this->begin = begin;
+        // The elements looked at here are traversed again from `begin`.
+        [[maybe_unused]] auto held = detail::hold(begin);
+        for (auto iter = begin; iter != end; ++iter, ++this->length) {
+            if (!predicate(*iter)) {
+                this->end = iter;
+                return;
+            }
+        }
+        this->end = end;
+    }
+};
+
+template <Iterable TCollection>
+struct Skip final : Stream<TCollection>
+{
+    explicit Skip(
+        usize count, usize length, const typename Skip::Iterator& begin, const typename Skip::Iterator& end
+    ) : Stream<TCollection>() {
+        this->end = end;
+        this->begin = detail::advance(begin, count, end);
+        this->length = length == this->UnknownLength ? length : length - std::min(count, length);
+    }
+};
+
+template <Iterable TCollection>
+struct Prefetch final : Stream<TCollection>
+{
+    explicit Prefetch(
+        usize distance, usize length, const typename Prefetch::Iterator& begin, const typename Prefetch::Iterator& end
+    ) : Stream<TCollection>() {
+        this->begin = begin;
+        this->end = end;
+        this->length = length;
+        this->prefetchDistance = distance;
+    }
+};
+
+template <
+    Iterable TCollection, Derives<Stream<TCollection>> TStream,
+    Predicate<typename TStream::Value> FPredicate>
+struct SkipWhile final : Stream<TCollection>
+{
+    explicit SkipWhile(
+        FPredicate predicate, usize length,
+        const typename SkipWhile::Iterator& begin, const typename SkipWhile::Iterator& end
     ) : Stream<TCollection>() {
         this->end = end;
-        auto iter = begin;
-        for (usize i = 0; i < count && iter != end; ++i) { ++iter; }
-        this->begin = iter;
+        this->length = length;
+        bool known = length != this->UnknownLength;
+        for (auto iter = begin; iter != end; ++iter, this->length -= known) {
+            if (!predicate(*iter)) {
+                this->begin = iter;
+                return;
+            }
+        }
+        this->begin = end;
+        this->length = 0;
+    }
+};
+
+template <typename R, typename FMapper>
+struct MapStage
+{
+    template <typename In>
+    using Output = R;
+    static constexpr bool Stateless = true;
+
+    FMapper mapper;
+
+    template <typename In, typename FNext>
+    bool push(const In& value, FNext& next) { return next(mapper(value)); }
+};
+
+template <typename FPredicate>
+struct FilterStage
+{
+    template <typename In>
+    using Output = In;
+    static constexpr bool Stateless = true;
+
+    FPredicate predicate;
+
+    template <typename In, typename FNext>
+    bool push(const In& value, FNext& next) { return !predicate(value) || next(value); }
+};
+
+struct TakeStage
+{
+    template <typename In>
+    using Output = In;
+
+    usize remaining;
+
+    template <typename In, typename FNext>
+    bool push(const In& value, FNext& next) {
+        if (remaining == 0) { return false; }
+        --remaining;
+        return next(value) && remaining != 0;
+    }
+};
+
+template <typename FPredicate>
+struct TakeWhileStage
+{
+    template <typename In>
+    using Output = In;
+
+    FPredicate predicate;
+
+    template <typename In, typename FNext>
+    bool push(const In& value, FNext& next) { return predicate(value) && next(value); }
+};
+
+struct SkipStage
+{
+    template <typename In>
+    using Output = In;
+
+    usize remaining;
+
+    template <typename In, typename FNext>
+    bool push(const In& value, FNext& next) {
+        if (remaining != 0) {
+            --remaining;
+            return true;
+        }
+        return next(value);
+    }
+};
+
+template <typename FPredicate>
+struct SkipWhileStage
+{
+    template <typename In>
+    using Output = In;
+
+    FPredicate predicate;
+    bool skipping = true;
+
+    template <typename In, typename FNext>
+    bool push(const In& value, FNext& next) {
+        if (skipping && predicate(value)) { return true; }
+        skipping = false;
+        return next(value);
+    }
+};
+
+// A stage whose output for an element depends on that element alone, like `map` and `filter`.
+template <typename TStage>
+concept StatelessStage = TStage::Stateless;
+
+template <typename In, typename... TStages>
+struct StageOutput
+{
+    using Type = In;
+};
+
+template <typename In, typename TStage, typename... TStages>
+struct StageOutput<In, TStage, TStages...>
+{
+    using Type = typename StageOutput<typename TStage::template Output<In>, TStages...>::Type;
+};
+
+namespace detail
+{
+    /**
+     * Per-thread spare batches for stages that copy elements into one. A stage borrows a
+     * batch when it starts filling it and gives it back once it is flushed, so runs do not
+     * allocate after the first on each thread, and stages that are busy at the same time
+     * never share one.
+     */
+    template <typename T>
+    class SpareBatches
+    {
+      private:
+
+        static std::vector<std::vector<T>>& spares() {
+            thread_local std::vector<std::vector<T>> batches;
+            return batches;
+        }
+
+      public:
+
+        static std::vector<T> borrow() {
+            std::vector<std::vector<T>>& batches = spares();
+            if (batches.empty()) {
+                std::vector<T> batch;
+                batch.reserve(MaskBatch);
+                return batch;
+            }
+            std::vector<T> batch = std::move(batches.back());
+            batches.pop_back();
+            return batch;
+        }
+
+        static void giveBack(std::vector<T>&& batch) {
+            batch.clear();
+            spares().push_back(std::move(batch));
+        }
+    };
+}
+
+/**
+ * Filters by a compiled predicate that every copy of the stage shares. The predicate runs
+ * once per `MaskBatch` elements, so its program is interpreted per batch rather than per
+ * element. A run over stable source elements hands the first stage batches of pointers;
+ * elsewhere elements are copied into a batch borrowed from `detail::SpareBatches`, and the
+ * last partial batch is passed on when the run flushes its stages.
+ */
+template <typename T>
+struct CompiledFilterStage
+{
+    template <typename In>
+    using Output = In;
+    static constexpr bool Stateless = true;
+
+    std::shared_ptr<const CompiledPredicate<T>> predicate;
+    std::vector<T> pending;
+
+    template <typename In, typename FNext>
+    bool push(const In& value, FNext& next) {
+        if (pending.capacity() == 0) { pending = detail::SpareBatches<T>::borrow(); }
+        pending.push_back(value);
+        return pending.size() < detail::MaskBatch || flush(next);
+    }
+
+    template <typename FNext>
+    bool push(const T* const* batch, usize count, FNext& next) {
+        std::array<uint8_t, detail::MaskBatch> mask;
+        predicate->evaluate(batch, count, mask.data());
+        // Compacts the hits without branching on the mask, then passes them on.
+        std::array<uint16_t, detail::MaskBatch> hits;
+        usize found = 0;
+        for (usize i = 0; i < count; ++i) {
+            hits[found] = uint16_t(i);
+            found += mask[i];
+        }
+        for (usize i = 0; i < found; ++i) {
+            if (!next(*batch[hits[i]])) { return false; }
+        }
+        return true;
+    }
+
+    template <typename FNext>
+    bool flush(FNext& next) {
+        if (pending.empty()) { return true; }
+        std::array<const T*, detail::MaskBatch> batch;
+        usize count = pending.size();
+        for (usize i = 0; i < count; ++i) { batch[i] = &pending[i]; }
+        bool proceed = push(batch.data(), count, next);
+        detail::SpareBatches<T>::giveBack(std::move(pending));
+        pending = {};
+        return proceed;
+    }
+};
+
+// The number of outputs in a `View`.
+struct CountAggregate
+{
+    usize count = 0;
+
+    void insert(const auto&) { ++count; }
+
+    void erase(const auto&) { --count; }
+
+    usize result() const { return count; }
+};
+
+// The sum of the outputs in a `View`, compensated for floating-point values so that
+// erasing does not leave drift behind.
+template <typename T> requires detail::Number<T>
+struct SumAggregate
+{
+    using Wide = detail::Wide<T>;
+
+    std::conditional_t<std::floating_point<T>, detail::Neumaier<Wide>, Wide> total {};
+
+    void insert(const T& value) {
+        if constexpr (std::floating_point<T>) { total.add(Wide(value)); } else { total += Wide(value); }
+    }
+
+    void erase(const T& value) {
+        if constexpr (std::floating_point<T>) { total.add(-Wide(value)); } else { total -= Wide(value); }
+    }
+
+    Wide result() const {
+        if constexpr (std::floating_point<T>) { return total.result(); } else { return total; }
+    }
+};
+
+/**
+ * The outputs in a `View`, kept in `TCollection`. Erasing removes one equal element, so
+ * use a multi-container such as `std::multiset` when distinct inputs can map to equal
+ * outputs.
+ */
+template <typename TCollection>
+struct CollectAggregate
+{
+    TCollection values;
+
+    void insert(const typename TCollection::value_type& value) { values.insert(value); }
+
+    void erase(const typename TCollection::value_type& value) {
+        auto iter = values.find(value);
+        if (iter != values.end()) { values.erase(iter); }
+    }
+
+    const TCollection& result() const { return values; }
+};
+
+// How many outputs in a `View` fall under each key. Keys whose count drops to zero are removed.
+template <typename K, typename FKey>
+struct GroupCountAggregate
+{
+    FKey key;
+    std::unordered_map<K, usize> counts;
+
+    explicit GroupCountAggregate(FKey key) : key(key) {}
+
+    void insert(const auto& value) { ++counts[key(value)]; }
+
+    void erase(const auto& value) {
+        auto iter = counts.find(key(value));
+        if (iter != counts.end() && --iter->second == 0) { counts.erase(iter); }
+    }
+
+    const std::unordered_map<K, usize>& result() const { return counts; }
+};
+
+namespace detail
+{
+    template <usize I, typename TStage>
+    struct StageSlot
+    {
+        TStage stage;
+    };
+
+    template <typename TIndices, typename... TStages>
+    struct StageSlots;
+
+    /**
+     * The stages of a pipeline, each in a base of its own. A `std::tuple` nests one class
+     * per element, all new for every longer prefix; here appending a stage reuses the
+     * slots before it, so building a chain instantiates a linear number of classes.
+     */
+    template <usize... I, typename... TStages>
+    struct StageSlots<std::index_sequence<I...>, TStages...> : StageSlot<I, TStages>...
+    {
+        template <typename TStage>
+        auto append(TStage stage) const
+            -> StageSlots<std::index_sequence<I..., sizeof...(I)>, TStages..., TStage>
+        {
+            return { static_cast<const StageSlot<I, TStages>&>(*this)..., { std::move(stage) } };
+        }
+    };
+
+    template <usize I, typename TStage>
+    TStage& stageAt(StageSlot<I, TStage>& slot) {
+        return slot.stage;
+    }
+}
+
+/**
+ * Stages built once, without a source, and applied to any number of sources. Work that
+ * does not depend on the source, such as compiling a `PredicateExpr`, happens when a
+ * stage is added. A run copies only the stages' own per-run state, like the counters of
+ * `take` and `skip`, so one pipeline can serve concurrent runs.
+ */
+template <typename In, typename... TStages>
+class Pipeline
+{
+  private:
+
+    template <typename, typename...>
+    friend class Pipeline;
+
+    template <Iterable, typename, typename, typename...>
+    friend class Incremental;
+
+    template <typename, typename, typename...>
+    friend class View;
+
+    using Slots = detail::StageSlots<std::index_sequence_for<TStages...>, TStages...>;
+
+    Slots stages;
+
+    template <typename TStage>
+    auto append(TStage stage) const -> Pipeline<In, TStages..., TStage> {
+        return Pipeline<In, TStages..., TStage>(stages.append(std::move(stage)));
+    }
+
+    template <usize I, typename T, typename FSink>
+    static bool push(Slots& stages, const T& value, FSink& sink) {
+        if constexpr (I == sizeof...(TStages)) {
+            return sink(value);
+        } else {
+            auto next = [&](const auto& output) { return push<I + 1>(stages, output, sink); };
+            return detail::stageAt<I>(stages).push(value, next);
+        }
+    }
+
+    /**
+     * Passes on what batching stages still hold, first to last, once a run has stopped.
+     * A stage that stopped the run was reached only through flushes that emptied every
+     * batch before it, so it is not pushed to again.
+     */
+    template <usize I = 0, typename FSink>
+    static void flush(Slots& stages, FSink& sink) {
+        if constexpr (I < sizeof...(TStages)) {
+            auto next = [&](const auto& output) { return push<I + 1>(stages, output, sink); };
+            auto& stage = detail::stageAt<I>(stages);
+            if constexpr (requires { stage.flush(next); }) { stage.flush(next); }
+            flush<I + 1>(stages, sink);
+        }
+    }
+
+    template <typename TIterator>
+    static constexpr bool BatchesSource = requires(
+        Slots& stages, const In* const* batch, std::function<bool(const In&)>& next
+    ) {
+        requires sizeof...(TStages) != 0;
+        requires std::forward_iterator<TIterator>;
+        requires std::same_as<std::iter_reference_t<TIterator>, const In&>
+            || std::same_as<std::iter_reference_t<TIterator>, In&>;
+        detail::stageAt<0>(stages).push(batch, usize(0), next);
+    };
+
+  public:
+
+    using Value = typename StageOutput<In, TStages...>::Type;
+
+    Pipeline() = default;
+
+    explicit Pipeline(Slots stages) : stages(std::move(stages)) {}
+
+    template <typename R, Mapper<Value, R> FMapper>
+    auto map(FMapper mapper) const -> Pipeline<In, TStages..., MapStage<R, FMapper>> {
+        return append(MapStage<R, FMapper> { mapper });
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto filter(FPredicate predicate) const -> Pipeline<In, TStages..., FilterStage<FPredicate>> {
+        return append(FilterStage<FPredicate> { predicate });
+    }
+
+    auto filter(const CompiledPredicate<Value>& predicate) const -> Pipeline<In, TStages..., CompiledFilterStage<Value>> {
+        return append(CompiledFilterStage<Value> { std::make_shared<const CompiledPredicate<Value>>(predicate), {} });
+    }
+
+    // Compiles `expr` once, here, rather than on every run.
+    auto filter(const PredicateExpr<Value>& expr) const -> Pipeline<In, TStages..., CompiledFilterStage<Value>> {
+        return filter(expr.compile());
+    }
+
+    auto take(usize count) const -> Pipeline<In, TStages..., TakeStage> {
+        return append(TakeStage { count });
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto takeWhile(FPredicate predicate) const -> Pipeline<In, TStages..., TakeWhileStage<FPredicate>> {
+        return append(TakeWhileStage<FPredicate> { predicate });
+    }
+
+    auto skip(usize count) const -> Pipeline<In, TStages..., SkipStage> {
+        return append(SkipStage { count });
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto skipWhile(FPredicate predicate) const -> Pipeline<In, TStages..., SkipWhileStage<FPredicate>> {
+        return append(SkipWhileStage<FPredicate> { predicate });
+    }
+
+    // Pushes `[begin, end)` through a fresh copy of the stages until `sink` returns false.
+    template <typename TIterator, typename FSink>
+    void feed(TIterator begin, const TIterator& end, FSink sink) const {
+        Slots state = stages;
+        if constexpr (BatchesSource<TIterator>) {
+            // The source's elements outlive the run, so the first stage can take pointers to them.
+            std::array<const In*, detail::MaskBatch> batch;
+            auto next = [&](const auto& output) { return push<1>(state, output, sink); };
+            while (begin != end) {
+                usize count = 0;
+                for (; count < batch.size() && begin != end; ++begin) { batch[count++] = &*begin; }
+                if (!detail::stageAt<0>(state).push(batch.data(), count, next)) { break; }
+            }
+        } else {
+            for (; begin != end; ++begin) {
+                if (!push<0>(state, *begin, sink)) { break; }
+            }
+        }
+        flush(state, sink);
+    }
+
+    // A lazy chain of these stages over `source`, which must outlive it.
+    template <Iterable TCollection>
+        requires std::same_as<typename TCollection::value_type, In>
+    auto apply(const TCollection& source) const -> Chain<TCollection, TStages...> {
+        return Chain<TCollection, TStages...>(source.begin(), source.end(), *this);
+    }
+
+    template <Iterable TCollection>
+        requires std::same_as<typename TCollection::value_type, In>
+    auto apply(const Stream<TCollection>& source) const -> Chain<TCollection, TStages...> {
+        return source.lazy().then(*this);
+    }
+
+    // Applies the stages to `source` and returns `terminal(chain)`, e.g. `chain.count()`.
+    template <typename TSource, typename FTerminal>
+    decltype(auto) run(const TSource& source, FTerminal terminal) const {
+        return terminal(apply(source));
+    }
+
+    // Folds `source` with `reducer`, from `init`, one appended batch at a time.
+    template <Iterable TCollection, typename R, Reducer<Value, R> FReducer>
+        requires std::same_as<typename TCollection::value_type, In>
+            && std::random_access_iterator<typename TCollection::const_iterator>
+    auto incremental(const TCollection& source, R init, FReducer reducer) const
+        -> Incremental<TCollection, R, FReducer, TStages...>
+    {
+        return Incremental<TCollection, R, FReducer, TStages...>(source, *this, std::move(init), reducer);
+    }
+
+    // Maintains `aggregate` over the outputs for `source` as elements are inserted and erased.
+    template <Iterable TCollection, typename TAggregate>
+        requires std::same_as<typename TCollection::value_type, In> && (StatelessStage<TStages> && ...)
+    auto view(const TCollection& source, TAggregate aggregate) const -> View<TAggregate, In, TStages...> {
+        return View<TAggregate, In, TStages...>(source.begin(), source.end(), *this, std::move(aggregate));
+    }
+
+    template <Iterable TCollection>
+    auto countView(const TCollection& source) const {
+        return view(source, CountAggregate {});
+    }
+
+    template <Iterable TCollection>
+    auto sumView(const TCollection& source) const requires detail::Number<Value> {
+        return view(source, SumAggregate<Value> {});
+    }
+
+    template <typename RCollection = std::multiset<Value>, Iterable TCollection>
+    auto collectView(const TCollection& source) const {
+        return view(source, CollectAggregate<RCollection> {});
+    }
+
+    template <Iterable TCollection, typename FKey>
+    auto groupCountView(const TCollection& source, FKey key) const {
+        using K = std::decay_t<std::invoke_result_t<FKey&, const Value&>>;
+        return view(source, GroupCountAggregate<K, FKey>(key));
+    }
+};
+
+/**
+ * A lazy pipeline over a source range. Stages are kept as a flat list of descriptors
+ * rather than nested stream types, and elements are pushed through all of them in a
+ * single pass when a terminal runs, without materializing intermediate collections.
+ */
+template <Iterable TCollection, typename... TStages>
+class Chain
+{
+  private:
+
+    template <Iterable, typename...>
+    friend class Chain;
+
+    using Iterator = typename TCollection::const_iterator;
+    using Stages = Pipeline<typename TCollection::value_type, TStages...>;
+
+    Iterator begin;
+    Iterator end;
+    Stages pipeline;
+    std::shared_ptr<const void> owner;
+
+    template <typename... UStages>
+    auto with(Pipeline<typename TCollection::value_type, UStages...> stages) const -> Chain<TCollection, UStages...> {
+        return Chain<TCollection, UStages...>(begin, end, std::move(stages), owner);
+    }
+
+    template <typename FSink>
+    void run(FSink sink) const {
+        pipeline.feed(begin, end, std::move(sink));
+    }
+
+  public:
+
+    using Value = typename Stages::Value;
+
+    Chain(const Iterator& begin, const Iterator& end, Stages pipeline = {}, std::shared_ptr<const void> owner = {})
+        : begin(begin), end(end), pipeline(std::move(pipeline)), owner(std::move(owner)) {}
+
+    // Appends the stages of `next` to these; only valid on a chain without stages yet.
+    template <typename... UStages>
+    auto then(const Pipeline<typename TCollection::value_type, UStages...>& next) const -> Chain<TCollection, UStages...>
+        requires (sizeof...(TStages) == 0)
+    {
+        return with(next);
+    }
+
+    template <typename R, Mapper<Value, R> FMapper>
+    auto map(FMapper mapper) const -> Chain<TCollection, TStages..., MapStage<R, FMapper>> {
+        return with(pipeline.template map<R>(mapper));
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto filter(FPredicate predicate) const -> Chain<TCollection, TStages..., FilterStage<FPredicate>> {
+        return with(pipeline.filter(predicate));
+    }
+
+    auto filter(const CompiledPredicate<Value>& predicate) const
+        -> Chain<TCollection, TStages..., CompiledFilterStage<Value>>
+    {
+        return with(pipeline.filter(predicate));
+    }
+
+    auto filter(const PredicateExpr<Value>& expr) const -> Chain<TCollection, TStages..., CompiledFilterStage<Value>> {
+        return with(pipeline.filter(expr));
+    }
+
+    auto take(usize count) const -> Chain<TCollection, TStages..., TakeStage> {
+        return with(pipeline.take(count));
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto takeWhile(FPredicate predicate) const -> Chain<TCollection, TStages..., TakeWhileStage<FPredicate>> {
+        return with(pipeline.takeWhile(predicate));
+    }
+
+    auto skip(usize count) const -> Chain<TCollection, TStages..., SkipStage> {
+        return with(pipeline.skip(count));
+    }
+
+    template <Predicate<Value> FPredicate>
+    auto skipWhile(FPredicate predicate) const -> Chain<TCollection, TStages..., SkipWhileStage<FPredicate>> {
+        return with(pipeline.skipWhile(predicate));
+    }
+
+    template <Consumer<const Value&> FConsumer>
+    void forEach(FConsumer consumer) const {
+        run([&](const Value& value) {
+            consumer(value);
+            return true;
+        });
+    }
+
+    template <typename R, Reducer<Value, R> FReducer>
+    R reduce(R init, FReducer reducer) const {
+        R result = init;
+        run([&](const Value& value) {
+            result = reducer(result, value);
+            return true;
+        });
+        return result;
+    }
+
+    usize count() const {
+        usize result = 0;
+        run([&](const Value&) {
+            ++result;
+            return true;
+        });
+        return result;
+    }
+
+    template <Predicate<Value> FPredicate>
+    bool any(FPredicate predicate) const {
+        bool found = false;
+        run([&](const Value& value) { return !(found = predicate(value)); });
+        return found;
+    }
+
+    template <Predicate<Value> FPredicate>
+    bool all(FPredicate predicate) const {
+        return !any([&](const Value& value) { return !predicate(value); });
+    }
+
+    template <typename RCollection>
+    RCollection collect() const {
+        if constexpr (Buildable<RCollection>) {
+            using Builder = typename Collection<RCollection>::Builder;
+            return Collection<RCollection>::build(collect<Builder>());
+        } else {
+            RCollection result;
+            run([&](const Value& value) {
+                Collection<RCollection>::insert(result, value);
+                return true;
+            });
+            return result;
+        }
     }
 };
 
-template <
-    Iterable TCollection, Derives<Stream<TCollection>> TStream,
-    Predicate<typename TStream::Value> FPredicate>
-struct SkipWhile final : Stream<TCollection>
+/**
+ * A fold of a pipeline over a source that only grows at the back, such as a vector that
+ * is appended to between reads. It remembers how far it has read, the state of its
+ * stages and the result so far, so `update` pushes only the elements appended since the
+ * last call. Positions are kept as indices, so reallocating the source is fine, but
+ * erasing from or reordering the part already read is not. The source must outlive it.
+ */
+template <Iterable TCollection, typename R, typename FReducer, typename... TStages>
+class Incremental
 {
-    explicit SkipWhile(
-        FPredicate predicate, const typename SkipWhile::Iterator& begin, const typename SkipWhile::Iterator& end
-    ) : Stream<TCollection>() {
-        this->end = end;
-        for (auto iter = begin; iter != end; ++iter) {
-            if (!predicate(*iter)) {
-                this->begin = iter;
-                return;
+  private:
+
+    using Stages = Pipeline<typename TCollection::value_type, TStages...>;
+
+    const TCollection* source;
+    Stages pipeline;
+    R folded;
+    FReducer reducer;
+    usize position = 0;
+    bool finished = false;
+
+  public:
+
+    using Value = typename Stages::Value;
+
+    Incremental(const TCollection& source, Stages pipeline, R init, FReducer reducer)
+        : source(&source), pipeline(std::move(pipeline)), folded(std::move(init)), reducer(reducer) {}
+
+    // Folds in the elements appended since the last update and returns the result.
+    const R& update() {
+        usize size = source->size();
+        if (size < position) { detail::fail<std::out_of_range>("Incremental::update: source shrank"); }
+        auto sink = [&](const Value& value) {
+            folded = reducer(std::move(folded), value);
+            return true;
+        };
+        auto iter = source->begin() + std::ptrdiff_t(position);
+        for (; !finished && position < size; ++position, ++iter) {
+            // A stage that stops, like a spent `take`, ends the fold for good.
+            finished = !Stages::template push<0>(pipeline.stages, *iter, sink);
+        }
+        Stages::flush(pipeline.stages, sink);
+        position = size;
+        return folded;
+    }
+
+    const R& result() const { return folded; }
+
+    // The number of source elements read so far.
+    usize processed() const { return position; }
+
+    // True once a stage has stopped the fold, so no appended element can change it.
+    bool done() const { return finished; }
+};
+
+/**
+ * An aggregate over the outputs of stateless stages, kept up to date as the source
+ * changes. Since each output depends only on its own input, inserting or erasing an
+ * element only pushes that element through the stages and adds or retracts its output,
+ * so an update costs the same as pushing one element.
+ * Call `insert` and `erase` after the element has actually been added to or removed
+ * from the source; a set that ignored a duplicate insert must not be reported.
+ */
+template <typename TAggregate, typename In, typename... TStages>
+class View
+{
+  private:
+
+    using Stages = Pipeline<In, TStages...>;
+
+    Stages pipeline;
+    TAggregate aggregate;
+
+  public:
+
+    using Value = typename Stages::Value;
+
+    template <typename TIterator>
+    View(TIterator begin, const TIterator& end, Stages pipeline, TAggregate aggregate)
+        : pipeline(std::move(pipeline)), aggregate(std::move(aggregate)) {
+        for (; begin != end; ++begin) { insert(*begin); }
+    }
+
+    void insert(const In& value) {
+        auto sink = [&](const Value& output) {
+            aggregate.insert(output);
+            return true;
+        };
+        Stages::template push<0>(pipeline.stages, value, sink);
+        Stages::flush(pipeline.stages, sink);
+    }
+
+    void erase(const In& value) {
+        auto sink = [&](const Value& output) {
+            aggregate.erase(output);
+            return true;
+        };
+        Stages::template push<0>(pipeline.stages, value, sink);
+        Stages::flush(pipeline.stages, sink);
+    }
+
+    // Erases `from` and inserts `to`, for an element updated in place.
+    void replace(const In& from, const In& to) {
+        erase(from);
+        insert(to);
+    }
+
+    decltype(auto) result() const { return aggregate.result(); }
+};
+
+/**
+ * Parallel terminals over a random-access stream, run as bulk tasks on an `Executor`.
+ * The range is split into one segment per NUMA node, cut on page boundaries for
+ * contiguous sources, and each worker task is pinned to a node while it runs and drains
+ * its own segment before helping with the others. Within a
+ * segment chunks are claimed in ascending order from a shared counter, and workers check
+ * the shared cancellation state before each chunk, so a hit found by one worker stops
+ * the others within one chunk.
+ */
+template <Iterable TCollection>
+class ParallelStream
+{
+  private:
+
+    using Iterator = typename TCollection::const_iterator;
+
+    static constexpr usize NotFound = std::numeric_limits<usize>::max();
+    static constexpr int64_t SampleNanos = 20'000;
+    static constexpr double ChunkNanos = 100'000;
+    static constexpr usize ChunksPerWorker = 8;
+
+    Iterator begin;
+    usize length;
+    Executor* executor;
+    usize threads;
+    usize fixedGrain = 0;
+    ParallelStats* stats = nullptr;
+    std::shared_ptr<const void> owner;
+
+    struct Segment
+    {
+        usize from;
+        usize to;
+        std::atomic<usize> next;
+    };
+
+    // Splits `[start, length)` into one segment per node, starting each on a page boundary.
+    std::vector<Segment> segments(usize start, usize nodes) const {
+        std::vector<Segment> result(nodes);
+        for (usize node = 0; node < nodes; ++node) {
+            usize from = start + (length - start) * node / nodes;
+            if constexpr (std::contiguous_iterator<Iterator>) {
+                if (node != 0) { from = detail::alignToPage(std::to_address(begin), from, length); }
             }
+            result[node].from = from;
+            result[node].next = from;
+            if (node != 0) { result[node - 1].to = from; }
         }
-        this->begin = end;
+        result[nodes - 1].to = length;
+        return result;
+    }
+
+    /**
+     * Runs `body` on the caller over a doubling prefix of the range until it has taken
+     * long enough to time, then picks a grain that gives each chunk roughly `ChunkNanos`
+     * of work while leaving every worker several chunks. Returns false if `body` asked
+     * to stop during the sample.
+     */
+    template <typename FBody>
+    bool sample(FBody& body, usize& start, usize& grain) const {
+        using Clock = std::chrono::steady_clock;
+        usize limit = length / (threads * ChunksPerWorker);
+        int64_t elapsed = 0;
+        Clock::time_point began = Clock::now();
+        for (usize step = 1; start < limit && elapsed < SampleNanos; step *= 2) {
+            usize to = std::min(start + step, limit);
+            bool proceed = body(0, start, to);
+            start = to;
+            elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - began).count();
+            if (!proceed) { return false; }
+        }
+        double elementNanos = start != 0 ? double(elapsed) / double(start) : 0;
+        usize ceiling = std::max<usize>(1, (length - start) / (threads * ChunksPerWorker));
+        grain = elementNanos > 0 ? usize(ChunkNanos / elementNanos) : ceiling;
+        grain = std::clamp<usize>(grain, 1, ceiling);
+        if (stats != nullptr) { *stats = ParallelStats { grain, elementNanos, start, 0 }; }
+        return true;
+    }
+
+    /**
+     * Calls `body(worker, from, to)` for consecutive chunks until they run out or it
+     * returns false, which stops that worker. Every chunk that is never claimed lies past
+     * one that some worker has already claimed in the same segment.
+     */
+    template <typename FBody>
+    void claim(FBody body) const {
+        usize start = 0;
+        usize grain = fixedGrain;
+        if (grain == 0 && !sample(body, start, grain)) { return; }
+        if (start == length) { return; }
+        const detail::NumaTopology& topology = detail::NumaTopology::get();
+        usize workers = std::min(threads, (length - start + grain - 1) / grain);
+        usize nodes = std::min(topology.nodes(), workers);
+        std::vector<Segment> parts = segments(start, nodes);
+        if (stats != nullptr) { *stats = ParallelStats { grain, stats->elementNanos, start, workers }; }
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto worker = [&](usize index) {
+            usize node = topology.nodeOf(index, workers);
+            usize home = node * nodes / topology.nodes();
+            detail::NumaTopology::Pin pin(topology, node);
+            try {
+                for (usize visited = 0; visited < nodes; ++visited) {
+                    Segment& segment = parts[(home + visited) % nodes];
+                    for (
+                        usize from = segment.next.fetch_add(grain);
+                        from < segment.to;
+                        from = segment.next.fetch_add(grain)
+                    ) {
+                        if (!body(index, from, std::min(from + grain, segment.to))) { return; }
+                    }
+                }
+            } catch (...) {
+                std::lock_guard lock(errorMutex);
+                if (!error) { error = std::current_exception(); }
+                for (Segment& segment : parts) { segment.next.store(segment.to); }
+            }
+        };
+        executor->bulk(workers, worker);
+        if (error) { std::rethrow_exception(error); }
+    }
+
+  public:
+
+    using Value = typename TCollection::value_type;
+
+    ParallelStream(
+        const Iterator& begin, usize length, Executor& executor, usize threads,
+        std::shared_ptr<const void> owner = {}
+    ) : begin(begin), length(length), executor(&executor),
+        threads(std::max<usize>(1, threads != 0 ? threads : executor.concurrency())), owner(std::move(owner)) {}
+
+    // Fixes the number of elements per chunk instead of measuring it from a sample.
+    ParallelStream& grain(usize elements) {
+        fixedGrain = elements;
+        return *this;
+    }
+
+    // Records the grain and the measured cost per element of each terminal run.
+    ParallelStream& instrument(ParallelStats& sink) {
+        stats = &sink;
+        return *this;
+    }
+
+    template <Predicate<Value> FPredicate>
+    bool any(FPredicate predicate) const {
+        std::atomic<bool> found = false;
+        claim([&](usize, usize from, usize to) {
+            if (found.load(std::memory_order_relaxed)) { return false; }
+            for (usize i = from; i < to; ++i) {
+                if (predicate(begin[i])) {
+                    found.store(true, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            return true;
+        });
+        return found;
+    }
+
+    template <Predicate<Value> FPredicate>
+    bool all(FPredicate predicate) const {
+        return !any([&](const Value& value) { return !predicate(value); });
+    }
+
+    // Chunks are claimed in ascending order, so once a worker claims a chunk past the
+    // best hit so far, every chunk that could still hold an earlier hit is already taken.
+    template <Predicate<Value> FPredicate>
+    std::optional<Value> findFirst(FPredicate predicate) const {
+        std::atomic<usize> first = NotFound;
+        claim([&](usize, usize from, usize to) {
+            if (from >= first.load(std::memory_order_relaxed)) { return false; }
+            for (usize i = from; i < to; ++i) {
+                if (predicate(begin[i])) {
+                    usize current = first.load(std::memory_order_relaxed);
+                    while (i < current && !first.compare_exchange_weak(current, i, std::memory_order_relaxed)) {}
+                    return false;
+                }
+            }
+            return true;
+        });
+        if (first == NotFound) { return std::nullopt; }
+        return begin[first];
+    }
+
+    /**
+     * Collects in parallel. Each worker allocates and fills its own buffers, so their
+     * pages are first touched on the worker's node. Sequence targets keep one buffer per
+     * chunk to preserve encounter order; other targets keep one collection per worker and
+     * merge them at the end.
+     */
+    template <typename RCollection>
+    RCollection collect() const {
+        if constexpr (Buildable<RCollection>) {
+            using Builder = typename Collection<RCollection>::Builder;
+            return Collection<RCollection>::build(collect<Builder>());
+        } else if constexpr (std::same_as<RCollection, std::vector<Value>>) {
+            using Chunk = std::pair<usize, std::vector<Value>>;
+            std::vector<std::vector<Chunk>> locals(threads);
+            claim([&](usize worker, usize from, usize to) {
+                std::vector<Value>& chunk = locals[worker].emplace_back(from, std::vector<Value>()).second;
+                chunk.reserve(to - from);
+                for (usize i = from; i < to; ++i) { Collection<RCollection>::insert(chunk, begin[i]); }
+                return true;
+            });
+            std::vector<Chunk> chunks;
+            for (std::vector<Chunk>& local : locals) { std::move(local.begin(), local.end(), std::back_inserter(chunks)); }
+            std::sort(chunks.begin(), chunks.end(), [](const Chunk& a, const Chunk& b) { return a.first < b.first; });
+            RCollection result;
+            result.reserve(length);
+            for (const Chunk& chunk : chunks) { result.insert(result.end(), chunk.second.begin(), chunk.second.end()); }
+            return result;
+        } else {
+            std::vector<std::optional<RCollection>> locals(threads);
+            claim([&](usize worker, usize from, usize to) {
+                if (!locals[worker]) { locals[worker].emplace(); }
+                for (usize i = from; i < to; ++i) { Collection<RCollection>::insert(*locals[worker], begin[i]); }
+                return true;
+            });
+            RCollection result;
+            for (const std::optional<RCollection>& local : locals) {
+                if (!local) { continue; }
+                for (const auto& value : *local) { Collection<RCollection>::insert(result, value); }
+            }
+            return result;
+        }
+    }
+
+    auto sum() const requires detail::Number<Value> && std::integral<Value> {
+        std::vector<detail::Wide<Value>> locals(threads);
+        claim([&](usize worker, usize from, usize to) {
+            for (usize i = from; i < to; ++i) { locals[worker] += begin[i]; }
+            return true;
+        });
+        return std::accumulate(locals.begin(), locals.end(), detail::Wide<Value>(0));
+    }
+
+    // Each worker summarizes its own chunks; the partial summaries are merged at the end.
+    SummaryStatistics<Value> summaryStatistics() const requires detail::Number<Value> {
+        std::vector<SummaryStatistics<Value>> locals(threads);
+        claim([&](usize worker, usize from, usize to) {
+            for (; from < to; from += detail::MaskBatch) {
+                locals[worker].accept(begin + from, std::min(detail::MaskBatch, to - from));
+            }
+            return true;
+        });
+        SummaryStatistics<Value> result;
+        for (const SummaryStatistics<Value>& local : locals) { result.merge(local); }
+        return result;
+    }
+
+    /**
+     * Samples the chunks each worker claims into its own reservoir and merges the
+     * reservoirs. The sample is uniform, but which one is drawn depends on how chunks
+     * were scheduled as well as on `seed`.
+     */
+    std::vector<Value> reservoirSample(usize k, uint64_t seed = std::random_device {}()) const {
+        std::vector<detail::Reservoir<Value>> locals;
+        locals.reserve(threads);
+        for (usize worker = 0; worker < threads; ++worker) {
+            locals.emplace_back(k, seed + worker * 0x9E3779B97F4A7C15);
+        }
+        claim([&](usize worker, usize from, usize to) {
+            locals[worker].offer(begin + from, begin + to);
+            return true;
+        });
+        for (usize i = 1; i < locals.size(); ++i) { locals[0].merge(std::move(locals[i])); }
+        return std::move(locals[0]).result();
+    }
+
+    Histogram histogram(double lo, double hi, usize bins) const requires detail::Number<Value> {
+        std::vector<Histogram> locals(threads, Histogram(lo, hi, bins));
+        claim([&](usize worker, usize from, usize to) {
+            locals[worker].accept(begin + from, to - from);
+            return true;
+        });
+        for (usize i = 1; i < locals.size(); ++i) { locals[0].merge(locals[i]); }
+        return locals[0];
+    }
+
+    /**
+     * Sums floating-point elements. Chunk partials are combined in encounter order, except
+     * in `SumMode::Deterministic`: there each block of the pairwise tree is summed by
+     * whichever chunk it starts in, and the blocks are then combined as the sequential
+     * stream would, so the result does not depend on the thread count or the grain.
+     */
+    auto sum(SumMode mode = SumMode::Deterministic) const requires std::floating_point<Value> {
+        using Wide = detail::Wide<Value>;
+        if (mode == SumMode::Deterministic) {
+            constexpr usize Block = detail::PairwiseLeaf << detail::DeterministicLevels;
+            std::vector<detail::Cascade<Wide>> blocks((length + Block - 1) / Block);
+            claim([&](usize, usize from, usize to) {
+                for (usize block = (from + Block - 1) / Block; block * Block < to; ++block) {
+                    usize first = block * Block;
+                    detail::pushLeaves(blocks[block], begin + first, std::min(length, first + Block) - first);
+                }
+                return true;
+            });
+            detail::Cascade<Wide> total;
+            for (const detail::Cascade<Wide>& block : blocks) { total.append(block); }
+            return total.result();
+        }
+        using Partial = std::pair<usize, detail::Neumaier<Wide>>;
+        std::vector<std::vector<Partial>> locals(threads);
+        claim([&](usize worker, usize from, usize to) {
+            detail::Neumaier<Wide>& partial = locals[worker].emplace_back(from, detail::Neumaier<Wide>()).second;
+            if (mode == SumMode::Fast) {
+                partial.sum = detail::sumLanes<Wide>(begin + from, to - from);
+            } else if (mode == SumMode::Compensated) {
+                for (usize i = from; i < to; ++i) { partial.add(begin[i]); }
+            } else {
+                detail::Cascade<Wide> cascade;
+                detail::pushLeaves(cascade, begin + from, to - from);
+                partial.sum = cascade.result();
+            }
+            return true;
+        });
+        std::vector<Partial> partials;
+        for (std::vector<Partial>& local : locals) { std::move(local.begin(), local.end(), std::back_inserter(partials)); }
+        std::sort(partials.begin(), partials.end(), [](const Partial& a, const Partial& b) { return a.first < b.first; });
+        detail::Neumaier<Wide> total;
+        for (const Partial& partial : partials) {
+            if (mode == SumMode::Compensated) {
+                total.merge(partial.second);
+            } else {
+                total.sum += partial.second.sum;
+            }
+        }
+        return total.result();
+    }
+
+    template <Predicate<Value> FPredicate>
+    std::optional<Value> findAny(FPredicate predicate) const {
+        std::atomic<usize> found = NotFound;
+        claim([&](usize, usize from, usize to) {
+            if (found.load(std::memory_order_relaxed) != NotFound) { return false; }
+            for (usize i = from; i < to; ++i) {
+                if (predicate(begin[i])) {
+                    found.store(i, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            return true;
+        });
+        if (found == NotFound) { return std::nullopt; }
+        return begin[found];
+    }
+};
+
+/**
+ * A stream over a `Range`, created without any backing container. Sums and averages
+ * are computed in closed form rather than by traversal.
+ */
+template <typename T> requires detail::Number<T>
+class NumericStream final : public Stream<Range<T>>
+{
+  private:
+
+    using Wide = detail::Wide<T>;
+
+    T first;
+    T step;
+
+    explicit NumericStream(const Range<T>& range) : Stream<Range<T>>(), first(range.front()), step(range.stride()) {
+        this->begin = range.begin();
+        this->end = range.end();
+        this->length = range.size();
+    }
+
+  public:
+
+    using Stream<Range<T>>::sum;
+
+    // Yields `from, from + step, ...` while the value has not reached `to`.
+    static NumericStream range(T from, T to, T step = T(1)) {
+        return NumericStream(Range<T>(from, to, step));
+    }
+
+    /**
+     * Counts up from `from` until the largest value of `T`, which is not included, or
+     * for `PTRDIFF_MAX` values when `T` spans more than a range can hold.
+     */
+    static NumericStream iota(T from) requires std::integral<T> {
+        using Unsigned = std::make_unsigned_t<Wide>;
+        Unsigned room = Unsigned(Wide(std::numeric_limits<T>::max())) - Unsigned(Wide(from));
+        Unsigned count = std::min(room, Unsigned(std::numeric_limits<std::ptrdiff_t>::max()));
+        return NumericStream(Range<T>(from, static_cast<T>(Unsigned(Wide(from)) + count)));
+    }
+
+    Wide sum() const {
+        Wide n = static_cast<Wide>(this->length);
+        if (n == 0) { return 0; }
+        if constexpr (std::is_floating_point_v<T>) {
+            return n * Wide(first) + Wide(step) * (n * (n - 1) / 2);
+        } else {
+            // Halve whichever of n and n - 1 is even so the product stays exact.
+            Wide triangle = n % 2 == 0 ? n / 2 * (n - 1) : (n - 1) / 2 * n;
+            return n * Wide(first) + Wide(step) * triangle;
+        }
+    }
+
+    std::optional<double> average() const {
+        if (this->length == 0) { return std::nullopt; }
+        return double(first) + double(step) * (double(this->length) - 1) / 2;
+    }
+
+    // Drops the closed-form shortcuts, leaving a plain stream over the same range.
+    Stream<Range<T>> boxed() const {
+        return *this;
+    }
+};
+
+using IntStream = NumericStream<int>;
+using LongStream = NumericStream<long long>;
+using DoubleStream = NumericStream<double>;
+
+namespace detail
+{
+    /**
+     * A window of the elements read from an input stream. `read(elements)` appends at
+     * least one element, or returns false once the input is exhausted. Before each read,
+     * elements more than `Lag` behind the furthest one dereferenced are released, so a
+     * single traversal holds a bounded window however long the input is; the lag keeps
+     * batches of pointers to recent elements valid. Iterators may run ahead without
+     * dereferencing, as `take` and counting do, and a `Hold` stops releases while a
+     * stage looks ahead and comes back. Elements live in a deque, so references to them
+     * survive later reads.
+     */
+    template <typename T, typename FRead>
+    class InputState
+    {
+      private:
+
+        static constexpr usize Lag = MaskBatch;
+
+        std::deque<T> elements;
+        FRead read;
+        usize base = 0;
+        usize furthest = 0;
+        usize holds = 0;
+        bool exhausted = false;
+
+        void release() {
+            if (holds != 0 || furthest < base + Lag) { return; }
+            usize count = std::min(furthest - Lag - base, elements.size());
+            elements.erase(elements.begin(), elements.begin() + std::ptrdiff_t(count));
+            base += count;
+            if constexpr (requires { read.release(count); }) { read.release(count); }
+        }
+
+      public:
+
+        class Hold
+        {
+          private:
+
+            std::shared_ptr<InputState> state;
+
+          public:
+
+            explicit Hold(std::shared_ptr<InputState> state) : state(std::move(state)) { ++this->state->holds; }
+
+            Hold(const Hold&) = delete;
+            Hold& operator=(const Hold&) = delete;
+
+            ~Hold() { --state->holds; }
+        };
+
+        explicit InputState(FRead read) : read(std::move(read)) {}
+
+        // Reads until `index` exists; returns false if the input ends first.
+        bool reach(usize index) {
+            while (index >= base + elements.size() && !exhausted) {
+                release();
+                exhausted = !read(elements);
+            }
+            return index < base + elements.size();
+        }
+
+        const T& at(usize index) {
+            if (index < base) { fail<std::logic_error>("InputStream: element already released; input is single-pass"); }
+            reach(index);
+            furthest = std::max(furthest, index);
+            return elements[index - base];
+        }
+    };
+
+    /**
+     * An input iterator over an `InputState` shared by all of its copies. The end
+     * iterator compares equal to any iterator that has run past the input.
+     */
+    template <typename T, typename TState>
+    class InputIterator
+    {
+      private:
+
+        static constexpr usize End = std::numeric_limits<usize>::max();
+
+        std::shared_ptr<TState> state;
+        usize index = End;
+
+        bool exhausted() const {
+            return index == End || state == nullptr || !state->reach(index);
+        }
+
+      public:
+
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using reference = const T&;
+        using pointer = const T*;
+
+        InputIterator() = default;
+
+        InputIterator(std::shared_ptr<TState> state, usize index) : state(std::move(state)), index(index) {}
+
+        const T& operator*() const {
+            return state->at(index);
+        }
+
+        const T* operator->() const {
+            return &**this;
+        }
+
+        InputIterator& operator++() {
+            ++index;
+            return *this;
+        }
+
+        InputIterator operator++(int) {
+            InputIterator old = *this;
+            ++index;
+            return old;
+        }
+
+        // Keeps what this iterator can reach from being released while the result lives.
+        auto hold() const -> typename TState::Hold {
+            return typename TState::Hold(state);
+        }
+
+        // Reads no further than the iterator that is not the end.
+        friend bool operator==(const InputIterator& a, const InputIterator& b) {
+            return a.index == b.index || (a.exhausted() && b.exhausted());
+        }
+    };
+
+    // Parses one element per call with `operator>>`.
+    template <typename T>
+    struct ParseValues
+    {
+        std::istream* input;
+
+        bool operator()(std::deque<T>& values) {
+            T value;
+            if (*input >> value) {
+                values.push_back(std::move(value));
+                return true;
+            }
+            if (!input->eof()) { fail("InputStream: malformed input"); }
+            return false;
+        }
+    };
+
+    /**
+     * Splits an input stream into lines, like `std::getline`, without allocating per line.
+     * Input is copied into blocks of at least `BlockSize` bytes and every line is a view
+     * into one of them; a line cut off by the end of a block moves to the start of the
+     * next. A block is freed once every line in it has been released. A refill takes
+     * what the stream buffer has ready, so a pipeline starts on the first lines of a
+     * pipe; buffers that cannot tell, like the stdio-synced `std::cin`, are read a whole
+     * block at a time.
+     */
+    class SplitLines
+    {
+      private:
+
+        static constexpr usize BlockSize = 256 * 1024;
+
+        struct Block
+        {
+            std::unique_ptr<char[]> bytes;
+            usize lines = 0;
+        };
+
+        std::istream* input;
+        std::deque<Block> blocks;
+        char* block = nullptr;
+        usize capacity = 0;
+        usize cursor = 0;
+        usize filled = 0;
+        bool eof = false;
+
+        void grow() {
+            usize tail = filled - cursor;
+            usize size = std::max(BlockSize, tail * 2);
+            blocks.push_back(Block { std::make_unique_for_overwrite<char[]>(size) });
+            if (tail != 0) { copyBytes(blocks.back().bytes.get(), block + cursor, tail); }
+            // Nothing else can point into a block that is behind and holds no lines.
+            if (blocks.size() > 1 && blocks[blocks.size() - 2].lines == 0) { blocks.erase(blocks.end() - 2); }
+            block = blocks.back().bytes.get();
+            capacity = size;
+            cursor = 0;
+            filled = tail;
+        }
+
+        void fill() {
+            if (filled == capacity) { grow(); }
+            std::streambuf* buffer = input->rdbuf();
+            std::streamsize space = std::streamsize(capacity - filled);
+            std::streamsize ready = buffer->in_avail();
+            if (ready <= 0) {
+                if (buffer->sgetc() == std::char_traits<char>::eof()) {
+                    eof = true;
+                    return;
+                }
+                ready = buffer->in_avail();
+            }
+            std::streamsize got = buffer->sgetn(block + filled, ready > 0 ? std::min(ready, space) : space);
+            filled += usize(got);
+            if (got == 0) { eof = true; }
+        }
+
+        void emit(std::deque<std::string_view>& lines, usize from, usize to) {
+            lines.emplace_back(block + from, to - from);
+            ++blocks.back().lines;
+        }
+
+      public:
+
+        explicit SplitLines(std::istream& input) : input(&input) {}
+
+        bool operator()(std::deque<std::string_view>& lines) {
+            usize before = lines.size();
+            while (true) {
+                while (cursor < filled) {
+                    const void* found = std::memchr(block + cursor, '\n', filled - cursor);
+                    if (found == nullptr) { break; }
+                    usize newline = usize(static_cast<const char*>(found) - block);
+                    emit(lines, cursor, newline);
+                    cursor = newline + 1;
+                }
+                if (lines.size() != before) { return true; }
+                if (eof) {
+                    if (cursor == filled) { return false; }
+                    emit(lines, cursor, filled);
+                    cursor = filled;
+                    return true;
+                }
+                fill();
+            }
+        }
+
+        // Frees the blocks whose lines are all among the `count` oldest still held.
+        void release(usize count) {
+            while (count != 0) {
+                Block& front = blocks.front();
+                usize dropped = std::min(count, front.lines);
+                front.lines -= dropped;
+                count -= dropped;
+                if (front.lines != 0 || blocks.size() == 1) { break; }
+                blocks.pop_front();
+            }
+        }
+    };
+}
+
+/**
+ * The elements of an input stream, read as they are first needed and released once a
+ * traversal is past them. The source is single-pass: stages that look ahead, like
+ * `take` and `takeWhile`, still work, but traversing it a second time throws. Its length
+ * is only known once the input is exhausted, and measuring it keeps every element read.
+ */
+template <typename T, typename FRead>
+class InputSource
+{
+  private:
+
+    using State = detail::InputState<T, FRead>;
+
+    std::shared_ptr<State> state;
+
+  public:
+
+    using value_type = T;
+    using const_iterator = detail::InputIterator<T, State>;
+    using iterator = const_iterator;
+
+    explicit InputSource(FRead read) : state(std::make_shared<State>(std::move(read))) {}
+
+    const_iterator begin() const {
+        return const_iterator(state, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(state, std::numeric_limits<usize>::max());
+    }
+};
+
+/**
+ * Input sources cannot be inserted into. Stages that materialize lines copy them into
+ * strings, since the views would not outlive the source's blocks.
+ */
+template <typename T, typename FRead>
+struct Collection<InputSource<T, FRead>>
+{
+    using Value = T;
+    template <typename R>
+    using WithValueType = std::vector<R>;
+    using Storage = std::vector<std::conditional_t<std::same_as<T, std::string_view>, std::string, T>>;
+    // Views into the source are released as it is read, so they cannot be collected.
+    static constexpr bool Transient = std::same_as<T, std::string_view>;
+};
+
+// Values parsed from an input stream with `operator>>`, as they are needed.
+template <typename T>
+class InputStream final : public Stream<InputSource<T, detail::ParseValues<T>>>
+{
+  private:
+
+    using Source = InputSource<T, detail::ParseValues<T>>;
+
+    explicit InputStream(const Source& source) : Stream<Source>() {
+        this->begin = source.begin();
+        this->end = source.end();
+        this->length = this->UnknownLength;
+    }
+
+  public:
+
+    // The stream must outlive every traversal of the returned one.
+    static InputStream from(std::istream& input) {
+        return InputStream(Source(detail::ParseValues<T> { &input }));
+    }
+};
+
+// The lines of an input stream, as views into large blocks read as they are needed.
+class LineStream final : public Stream<InputSource<std::string_view, detail::SplitLines>>
+{
+  private:
+
+    using Source = InputSource<std::string_view, detail::SplitLines>;
+
+    explicit LineStream(const Source& source) : Stream<Source>() {
+        this->begin = source.begin();
+        this->end = source.end();
+        this->length = this->UnknownLength;
+    }
+
+  public:
+
+    /**
+     * The stream must outlive every traversal of the returned one. Lines are views into
+     * blocks that are freed as reading moves on, so terminals that return lines, like
+     * `max`, `findFirst` or `partition`, return `std::string`s, and collecting
+     * `std::string_view`s does not compile.
+     */
+    static LineStream lines(std::istream& input) {
+        return LineStream(Source(detail::SplitLines(input)));
     }
 };
 
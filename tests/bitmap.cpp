@@ -0,0 +1,160 @@
+#include "check.hpp"
+
+#include <stream.hpp>
+
+#include <algorithm>
+#include <random>
+
+using Values = std::vector<uint32_t>;
+
+// Groups holding more members than this are stored as bitsets.
+constexpr uint32_t ArrayLimit = 4096;
+
+// Sorted distinct values drawn from `[from, from + span)`.
+static Values draw(std::mt19937& random, usize count, uint32_t from, uint32_t span) {
+    std::uniform_int_distribution<uint32_t> offset(0, span - 1);
+    Values result;
+    for (usize i = 0; i < count; ++i) { result.push_back(from + offset(random)); }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+static Values join(Values a, const Values& b) {
+    a.insert(a.end(), b.begin(), b.end());
+    std::sort(a.begin(), a.end());
+    a.erase(std::unique(a.begin(), a.end()), a.end());
+    return a;
+}
+
+static void checkHolds(const Bitmap& bitmap, const Values& expected) {
+    CHECK(bitmap.size() == expected.size());
+    CHECK(bitmap.empty() == expected.empty());
+    CHECK(std::equal(bitmap.begin(), bitmap.end(), expected.begin(), expected.end()));
+    for (uint32_t value : expected) { CHECK(bitmap.contains(value)); }
+}
+
+static void checkOperators(const Values& a, const Values& b) {
+    Values unite, intersect, subtract;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(unite));
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(intersect));
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(subtract));
+
+    Bitmap x(a), y(b);
+    checkHolds(x | y, unite);
+    checkHolds(x & y, intersect);
+    checkHolds(x - y, subtract);
+
+    Bitmap z = x;
+    z |= y;
+    CHECK(z == Bitmap(unite));
+    z = x;
+    z &= y;
+    CHECK(z == Bitmap(intersect));
+    z = x;
+    z -= y;
+    CHECK(z == Bitmap(subtract));
+}
+
+// Sparse groups stay arrays, dense groups become bitsets, and mixed pairs meet in between.
+static void operatorsMatchSetAlgorithms() {
+    std::mt19937 random(7);
+    std::vector<Values> inputs {
+        {},
+        draw(random, 3'000, 0, 1 << 20),
+        draw(random, 3'000, 1 << 18, 1 << 20),
+        draw(random, 60'000, 0, 3 << 16),
+        draw(random, 50'000, 1 << 16, 3 << 16),
+        { 0, 65'535, 65'536, 1u << 31, UINT32_MAX },
+    };
+    // One group just below and one just above `ArrayLimit`.
+    Values below, above;
+    for (uint32_t i = 0; i < ArrayLimit; ++i) { below.push_back(5 << 16 | i * 3); }
+    for (uint32_t i = 0; i <= ArrayLimit; ++i) { above.push_back(5 << 16 | i * 2); }
+    inputs.push_back(below);
+    inputs.push_back(above);
+    inputs.push_back(join(inputs[3], above));
+
+    for (const Values& a : inputs) {
+        for (const Values& b : inputs) { checkOperators(a, b); }
+    }
+}
+
+// Crossing `ArrayLimit` converts a group without losing or reordering its members.
+static void insertCrossesArrayLimit() {
+    Bitmap bitmap;
+    Values expected;
+    for (uint32_t i = ArrayLimit + 100; i-- > 0;) {
+        uint32_t value = 9 << 16 | i * 11;
+        CHECK(bitmap.insert(value));
+        CHECK(!bitmap.insert(value));
+        expected.push_back(value);
+    }
+    std::sort(expected.begin(), expected.end());
+    checkHolds(bitmap, expected);
+
+    CHECK(bitmap.insert(1));
+    CHECK(bitmap.insert(UINT32_MAX));
+    expected.insert(expected.begin(), 1);
+    expected.push_back(UINT32_MAX);
+    checkHolds(bitmap, expected);
+}
+
+// Results that shrink below `ArrayLimit`, or empty out, still behave like fresh bitmaps.
+static void resultsSettle() {
+    Values dense, kept;
+    for (uint32_t i = 0; i < 20'000; ++i) { dense.push_back(i); }
+    for (uint32_t i = 0; i < 20'000; i += 1'000) { kept.push_back(i); }
+    Values rest;
+    std::set_difference(dense.begin(), dense.end(), kept.begin(), kept.end(), std::back_inserter(rest));
+
+    Bitmap shrunk = Bitmap(dense) - Bitmap(rest);
+    checkHolds(shrunk, kept);
+    CHECK(shrunk.insert(5));
+    CHECK(!shrunk.contains(6));
+    kept.insert(kept.begin() + 1, 5);
+    checkHolds(shrunk, kept);
+
+    Bitmap overlap = Bitmap(dense) & Bitmap(kept);
+    checkHolds(overlap, kept);
+
+    Bitmap emptied = Bitmap(dense) - Bitmap(dense);
+    checkHolds(emptied, {});
+    CHECK(emptied.begin() == emptied.end());
+    CHECK(emptied.insert(70'000));
+    checkHolds(emptied, { 70'000 });
+
+    Bitmap grown = Bitmap(kept) | Bitmap(rest);
+    checkHolds(grown, join(kept, rest));
+}
+
+// Slices of a bitmap are copied into one before combining; whole bitmaps are used directly.
+static void streamsCombineBitmaps() {
+    std::mt19937 random(11);
+    Values a = draw(random, 40'000, 0, 1 << 18);
+    Values b = draw(random, 5'000, 1 << 17, 1 << 18);
+    Bitmap x(a), y(b);
+
+    usize half = a.size() / 2;
+    Values prefix(a.begin(), a.begin() + half);
+    Values unite;
+    std::set_union(prefix.begin(), prefix.end(), b.begin(), b.end(), std::back_inserter(unite));
+    auto sliced = Stream(x).take(half).unionWith(Stream(y));
+    static_assert(std::same_as<decltype(sliced), Combined<Bitmap>>);
+    CHECK(sliced.collect<Values>() == unite);
+
+    Values intersect;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(intersect));
+    CHECK(Stream(x).intersectWith(Stream(y)).collect<Values>() == intersect);
+
+    Bitmap none;
+    CHECK(Stream(x).intersectWith(Stream(none)).count() == 0);
+    CHECK(Stream(x).differenceWith(Stream(none)).collect<Values>() == a);
+}
+
+int main() {
+    operatorsMatchSetAlgorithms();
+    insertCrossesArrayLimit();
+    resultsSettle();
+    streamsCombineBitmaps();
+}
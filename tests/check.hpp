@@ -0,0 +1,16 @@
+#ifndef STREAM_HPP_TESTS_CHECK_HPP
+#define STREAM_HPP_TESTS_CHECK_HPP
+
+#include <cstdio>
+#include <cstdlib>
+
+// Like `assert`, but also checked in release builds.
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::abort();                                                                \
+        }                                                                                \
+    } while (false)
+
+#endif
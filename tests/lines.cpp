@@ -0,0 +1,93 @@
+#include "check.hpp"
+
+#include <stream.hpp>
+
+#include <sstream>
+
+// Many blocks' worth of input, so views from the first blocks are freed by the time
+// a terminal returns.
+static constexpr usize Lines = 200'000;
+
+static std::string numbered(usize index) {
+    char text[16];
+    std::snprintf(text, sizeof(text), "line-%06zu", index);
+    return text;
+}
+
+static std::string input(usize from = 0, usize to = Lines) {
+    std::string text;
+    for (usize i = from; i < to; ++i) { text += numbered(i) + '\n'; }
+    return text;
+}
+
+static bool isLine(const std::string& line) {
+    return line.size() == 11 && line.starts_with("line-");
+}
+
+static void inputSpansManyBlocks() {
+    CHECK(input().size() > 256 * 1024 * 4);
+}
+
+static void terminalsReturnOwnedLines() {
+    std::istringstream in(input());
+    static_assert(std::same_as<decltype(LineStream::lines(in).max()), std::optional<std::string>>);
+    CHECK(LineStream::lines(in).max() == numbered(Lines - 1));
+    in = std::istringstream(input());
+    CHECK(LineStream::lines(in).min() == numbered(0));
+    in = std::istringstream(input());
+    auto last = LineStream::lines(in).reduce([](std::string_view, std::string_view line) { return line; });
+    CHECK(last == numbered(Lines - 1));
+    in = std::istringstream(input());
+    CHECK(LineStream::lines(in).findFirst() == numbered(0));
+    in = std::istringstream(input());
+    CHECK(LineStream::lines(in).findAny([](std::string_view line) { return line.ends_with("150000"); }) == numbered(150000));
+}
+
+static void samplesOwnTheirLines() {
+    std::istringstream in(input());
+    std::vector<std::string> sample = LineStream::lines(in).reservoirSample(64, 7);
+    CHECK(sample.size() == 64);
+    for (const std::string& line : sample) { CHECK(isLine(line)); }
+}
+
+static void partitionsOwnTheirLines() {
+    std::istringstream in(input());
+    auto [even, odd] = LineStream::lines(in).partition([](std::string_view line) { return (line.back() - '0') % 2 == 0; });
+    CHECK(even.size() == Lines / 2 && odd.size() == Lines / 2);
+    CHECK(even.front() == numbered(0) && odd.back() == numbered(Lines - 1));
+
+    in = std::istringstream(input());
+    std::vector<std::vector<std::string>> parts = LineStream::lines(in).split([](std::string_view line) {
+        return usize(line.back() - '0') % 3;
+    }, 3);
+    CHECK(parts[0].size() + parts[1].size() + parts[2].size() == Lines);
+    for (const auto& part : parts) { CHECK(isLine(part.front()) && isLine(part.back())); }
+}
+
+static void setOperationsOwnTheirLines() {
+    std::istringstream a(input(0, Lines));
+    std::istringstream b(input(Lines / 2, Lines + Lines / 2));
+    auto both = LineStream::lines(a).intersectWith(LineStream::lines(b)).collect<std::vector<std::string>>();
+    CHECK(both.size() == Lines / 2);
+    CHECK(both.front() == numbered(Lines / 2) && both.back() == numbered(Lines - 1));
+
+    a = std::istringstream(input(0, Lines));
+    b = std::istringstream(input(Lines / 2, Lines + Lines / 2));
+    auto either = LineStream::lines(a).unionWith(LineStream::lines(b)).collect<std::vector<std::string>>();
+    CHECK(either.size() == Lines + Lines / 2);
+    CHECK(either.back() == numbered(Lines + Lines / 2 - 1));
+
+    a = std::istringstream(input(0, Lines));
+    b = std::istringstream(input(Lines / 2, Lines + Lines / 2));
+    auto only = LineStream::lines(a).differenceWith(LineStream::lines(b)).collect<std::vector<std::string>>();
+    CHECK(only.size() == Lines / 2);
+    CHECK(only.front() == numbered(0) && only.back() == numbered(Lines / 2 - 1));
+}
+
+int main() {
+    inputSpansManyBlocks();
+    terminalsReturnOwnedLines();
+    samplesOwnTheirLines();
+    partitionsOwnTheirLines();
+    setOperationsOwnTheirLines();
+}
@@ -0,0 +1,55 @@
+#include "check.hpp"
+
+#include <stream.hpp>
+
+#include <list>
+
+static std::vector<int> values(int count) {
+    std::vector<int> result;
+    for (int i = 0; i < count; ++i) { result.push_back(i * 7 % 1000); }
+    return result;
+}
+
+// Vector outputs of contiguous arithmetic streams are sized exactly.
+static void partitionSizesOutputsExactly() {
+    std::vector<int> source = values(10'000);
+    auto small = [](int value) { return value < 300; };
+    auto [accepted, rejected] = Stream(source).partition(small);
+    CHECK(accepted.size() + rejected.size() == source.size());
+    CHECK(accepted.capacity() == accepted.size());
+    CHECK(rejected.capacity() == rejected.size());
+
+    std::list<int> nodes(source.begin(), source.end());
+    auto [slowAccepted, slowRejected] = Stream(nodes).partition(small);
+    CHECK(accepted == slowAccepted);
+    CHECK(rejected == slowRejected);
+
+    std::vector<int> empty;
+    auto [none, nothing] = Stream(empty).partition(small);
+    CHECK(none.empty() && nothing.empty());
+}
+
+// Splits agree with the generic path for every width of class index.
+static void splitRoutesEveryElement() {
+    std::vector<int> source = values(10'000);
+    std::list<int> nodes(source.begin(), source.end());
+    for (usize outputs : { usize(3), usize(256), usize(257), usize(70'000) }) {
+        auto classify = [&](int value) { return usize(value) * 31 % outputs; };
+        std::vector<std::vector<int>> fast = Stream(source).split(classify, outputs);
+        std::vector<std::vector<int>> slow = Stream(nodes).split(classify, outputs);
+        CHECK(fast == slow);
+        for (const auto& part : fast) { CHECK(part.capacity() == part.size()); }
+    }
+    bool thrown = false;
+    try {
+        Stream(source).split([](int value) { return usize(value); }, 10);
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main() {
+    partitionSizesOutputsExactly();
+    splitRoutesEveryElement();
+}
@@ -0,0 +1,71 @@
+#include "check.hpp"
+
+#include <stream.hpp>
+
+#include <new>
+
+static usize allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* memory = std::malloc(size)) { return memory; }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+struct Item
+{
+    int id;
+    double price;
+};
+
+using Expr = PredicateExpr<Item>;
+
+static std::vector<Item> items(int count) {
+    std::vector<Item> result;
+    for (int i = 0; i < count; ++i) { result.push_back({ i, double(i % 100) }); }
+    return result;
+}
+
+static void chainsWithoutStagesRun() {
+    std::vector<int> values = { 1, 2, 3 };
+    CHECK(Stream(values).lazy().count() == 3);
+    CHECK(Pipeline<int>().apply(values).count() == 3);
+}
+
+// Compiled filters that copy elements into batches agree with the lambda, including
+// two of them active in one run and partial batches at the end.
+static void compiledFiltersMatchLambdas() {
+    std::vector<Item> source = items(1000);
+    auto cheap = [](const Item& item) { return item.price < 50; };
+    auto even = [](const Item& item) { return item.id % 2 == 0; };
+    auto copy = [](const Item& item) { return item; };
+    usize expected = Stream(source).count([&](const Item& item) { return cheap(item) && even(item); });
+    auto chain = Stream(source).lazy()
+        .map<Item>(copy).filter(Expr::field(&Item::price) < 50.0)
+        .map<Item>(copy).filter(Expr::field(&Item::id) < 1000 && Expr::field(&Item::price) >= 0.0)
+        .filter(even);
+    CHECK(chain.count() == expected);
+    CHECK(Stream(source).lazy().filter(Expr::field(&Item::price) < 50.0).take(7).count() == 7);
+}
+
+// After the first run on a thread, runs that batch copies do not allocate.
+static void batchesAreReusedAcrossRuns() {
+    std::vector<Item> source = items(300);
+    auto pipeline = Pipeline<Item>()
+        .map<Item>([](const Item& item) { return item; })
+        .filter(Expr::field(&Item::price) < 50.0);
+    usize expected = pipeline.apply(source).count();
+    usize before = allocations;
+    for (int run = 0; run < 1000; ++run) { CHECK(pipeline.apply(source).count() == expected); }
+    CHECK(allocations == before);
+}
+
+int main() {
+    chainsWithoutStagesRun();
+    compiledFiltersMatchLambdas();
+    batchesAreReusedAcrossRuns();
+}
@@ -0,0 +1,51 @@
+#include "check.hpp"
+
+#include <stream.hpp>
+
+#include <cstring>
+
+struct Row
+{
+    int x;
+    double price;
+    std::string name;
+    std::string_view tag;
+};
+
+static std::vector<Row> rows() {
+    return { { 2, 1.5, "ant", "a" }, { 3, 2.5, "bee", "b" }, { -1, 0.5, "cat", "c" } };
+}
+
+using Expr = PredicateExpr<Row>;
+
+// Comparisons match the lambda that spells out the same condition.
+template <typename FPredicate>
+static void agrees(const Expr& expr, FPredicate predicate) {
+    std::vector<Row> values = rows();
+    CHECK(Stream(values).count(expr) == Stream(values).count(predicate));
+    CHECK(Stream(values).lazy().filter(expr).count() == Stream(values).count(predicate));
+}
+
+static void numbersCompareInTheirCommonType() {
+    agrees(Expr::field(&Row::x) < 2.5, [](const Row& row) { return row.x < 2.5; });
+    agrees(Expr::field(&Row::x) == 2.0, [](const Row& row) { return row.x == 2.0; });
+    agrees(Expr::field(&Row::x) > 2.9, [](const Row& row) { return row.x > 2.9; });
+    agrees(Expr::field(&Row::price) >= 2, [](const Row& row) { return row.price >= 2; });
+    agrees(Expr::field(&Row::x) < int64_t(3), [](const Row& row) { return row.x < int64_t(3); });
+}
+
+static void stringOperandsAreCopied() {
+    char query[8];
+    std::strcpy(query, "bee");
+    Expr byName = Expr::field(&Row::name) == query;
+    Expr byTag = Expr::field(&Row::tag) < query;
+    std::strcpy(query, "zzz");
+    agrees(byName, [](const Row& row) { return row.name == "bee"; });
+    agrees(byTag, [](const Row& row) { return row.tag < "bee"; });
+    agrees(Expr::field(&Row::name) != "cat", [](const Row& row) { return row.name != "cat"; });
+}
+
+int main() {
+    numbersCompareInTheirCommonType();
+    stringOperandsAreCopied();
+}
@@ -0,0 +1,84 @@
+#include "check.hpp"
+
+#include <stream.hpp>
+
+#include <climits>
+
+template <typename T>
+static std::vector<T> elements(NumericStream<T> stream) {
+    return stream.template collect<std::vector<T>>();
+}
+
+// Strides that span most of the type divide before rounding up, so the count cannot wrap.
+static void rangeCountsWideStrides() {
+    auto quarters = LongStream::range(LLONG_MIN, LLONG_MAX, 1LL << 62);
+    CHECK(quarters.count() == 4);
+    CHECK((elements(quarters) == std::vector<long long> { LLONG_MIN, -(1LL << 62), 0, 1LL << 62 }));
+
+    auto halves = LongStream::range(LLONG_MAX, LLONG_MIN, LLONG_MIN);
+    CHECK((elements(halves) == std::vector<long long> { LLONG_MAX, -1 }));
+
+    bool thrown = false;
+    try {
+        LongStream::range(LLONG_MIN, LLONG_MAX);
+    } catch (const std::length_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+static void rangeStepsDownward() {
+    CHECK((elements(IntStream::range(10, 0, -3)) == std::vector<int> { 10, 7, 4, 1 }));
+    CHECK((elements(IntStream::range(10, 1, -3)) == std::vector<int> { 10, 7, 4 }));
+    CHECK(IntStream::range(0, 10, -1).count() == 0);
+    CHECK(IntStream::range(10, 0).count() == 0);
+    CHECK((elements(DoubleStream::range(1.0, 0.0, -0.25)) == std::vector<double> { 1.0, 0.75, 0.5, 0.25 }));
+
+    bool thrown = false;
+    try {
+        IntStream::range(0, 10, 0);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+// The closed forms agree with summing the same range element by element.
+static void sumAndAverageMatchTraversal() {
+    auto check = [](auto stream) {
+        auto boxed = stream.boxed();
+        auto total = boxed.sum();
+        CHECK(stream.sum() == total);
+        if (stream.count() == 0) {
+            CHECK(!stream.average());
+        } else {
+            CHECK(*stream.average() == double(total) / double(stream.count()));
+        }
+    };
+    check(IntStream::range(0, 0));
+    check(IntStream::range(-7, 100));
+    check(IntStream::range(100, -7, -3));
+    check(IntStream::range(INT_MAX - 10, INT_MAX));
+    check(LongStream::range(-1'000'000, 1'000'000, 7));
+    check(LongStream::range(3'000'000'000LL, -3'000'000'000LL, -999'999));
+    check(DoubleStream::range(0.5, 64.0, 0.5));
+}
+
+static void iotaCountsToTheLargestValue() {
+    CHECK((elements(LongStream::iota(LLONG_MAX - 3)) == std::vector<long long> { LLONG_MAX - 3, LLONG_MAX - 2, LLONG_MAX - 1 }));
+    CHECK(IntStream::iota(INT_MAX).count() == 0);
+    CHECK(IntStream::iota(INT_MIN).count() == usize(UINT_MAX));
+    CHECK((IntStream::iota(5).take(3).collect<std::vector<int>>() == std::vector<int> { 5, 6, 7 }));
+
+    // Types spanning more than a range can hold stop after `PTRDIFF_MAX` values.
+    CHECK(LongStream::iota(LLONG_MIN).count() == usize(PTRDIFF_MAX));
+    CHECK(LongStream::iota(0).count() == usize(LLONG_MAX));
+    CHECK(NumericStream<unsigned long long>::iota(0).count() == usize(PTRDIFF_MAX));
+}
+
+int main() {
+    rangeCountsWideStrides();
+    rangeStepsDownward();
+    sumAndAverageMatchTraversal();
+    iotaCountsToTheLargestValue();
+}
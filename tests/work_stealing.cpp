@@ -0,0 +1,137 @@
+#include "check.hpp"
+
+#include <stream.hpp>
+
+#include <ctime>
+
+static void dequeIsLifoForTheOwner() {
+    detail::WorkStealingDeque<int> deque(4);
+    std::vector<int> values(100);
+    CHECK(deque.pop() == nullptr);
+    CHECK(deque.steal() == nullptr);
+    for (int& value : values) { deque.push(&value); }
+    CHECK(!deque.empty());
+    CHECK(deque.steal() == &values[0]);
+    for (usize i = values.size() - 1; i > 0; --i) { CHECK(deque.pop() == &values[i]); }
+    CHECK(deque.empty());
+    CHECK(deque.pop() == nullptr);
+}
+
+// Every pushed item is taken exactly once, by the owner or by one of the thieves.
+static void dequeHandsOutEachItemOnce() {
+    constexpr usize Items = 200'000;
+    detail::WorkStealingDeque<usize> deque;
+    std::vector<usize> items(Items);
+    std::vector<std::atomic<int>> taken(Items);
+    std::atomic<bool> done = false;
+    auto record = [&](usize* item) { taken[*item].fetch_add(1); };
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; ++t) {
+        thieves.emplace_back([&] {
+            while (!done.load()) {
+                if (usize* item = deque.steal()) { record(item); }
+            }
+        });
+    }
+    for (usize i = 0; i < Items; ++i) {
+        items[i] = i;
+        deque.push(&items[i]);
+        if (i % 3 == 0) {
+            if (usize* item = deque.pop()) { record(item); }
+        }
+    }
+    while (usize* item = deque.pop()) { record(item); }
+    done = true;
+    for (std::thread& thief : thieves) { thief.join(); }
+    while (usize* item = deque.steal()) { record(item); }
+    for (const std::atomic<int>& count : taken) { CHECK(count.load() == 1); }
+}
+
+static void bulkRunsEveryIndexOnce() {
+    WorkStealingPool pool(4);
+    pool.bulk(0, [](usize) { CHECK(false); });
+    for (usize count : { usize(1), usize(3), usize(4), usize(1000), usize(100'000) }) {
+        std::vector<std::atomic<int>> runs(count);
+        pool.bulk(count, [&](usize i) { runs[i].fetch_add(1); });
+        for (const std::atomic<int>& run : runs) { CHECK(run.load() == 1); }
+    }
+}
+
+static void bulkRethrowsTheFirstError() {
+    WorkStealingPool pool(3);
+    std::atomic<usize> runs = 0;
+    bool caught = false;
+    try {
+        pool.bulk(100, [&](usize i) {
+            runs.fetch_add(1);
+            if (i == 42) { throw std::runtime_error("task failed"); }
+        });
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    CHECK(caught);
+    CHECK(runs.load() == 100);
+}
+
+static void nestedBulkCompletes() {
+    WorkStealingPool pool(2);
+    std::atomic<usize> runs = 0;
+    pool.bulk(8, [&](usize) { pool.bulk(8, [&](usize) { runs.fetch_add(1); }); });
+    CHECK(runs.load() == 64);
+}
+
+// The caller must hand work out rather than keep the whole range for itself.
+static void workersShareTheCallersJob() {
+    WorkStealingPool pool(4);
+    for (int round = 0; round < 20; ++round) {
+        std::mutex mutex;
+        std::set<std::thread::id> threads;
+        pool.bulk(8, [&](usize) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            std::lock_guard lock(mutex);
+            threads.insert(std::this_thread::get_id());
+        });
+        CHECK(threads.size() > 1);
+    }
+}
+
+#if defined(__linux__)
+static double threadCpuMillis() {
+    timespec time {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return double(time.tv_sec) * 1e3 + double(time.tv_nsec) / 1e6;
+}
+
+// A caller whose own share is done sleeps until the workers finish instead of spinning.
+static void waitingCallerSleeps() {
+    WorkStealingPool pool(3);
+    std::thread::id caller = std::this_thread::get_id();
+    std::atomic<int> started = 0;
+    double before = threadCpuMillis();
+    pool.bulk(3, [&](usize) {
+        if (std::this_thread::get_id() != caller) {
+            started.fetch_add(1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            return;
+        }
+        // Leave the other two tasks to the workers, then run out of work.
+        for (int tries = 0; started.load() < 2; ++tries) {
+            CHECK(tries < 2000);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    CHECK(threadCpuMillis() - before < 50);
+}
+#endif
+
+int main() {
+    dequeIsLifoForTheOwner();
+    dequeHandsOutEachItemOnce();
+    bulkRunsEveryIndexOnce();
+    bulkRethrowsTheFirstError();
+    nestedBulkCompletes();
+    workersShareTheCallersJob();
+#if defined(__linux__)
+    waitingCallerSleeps();
+#endif
+}